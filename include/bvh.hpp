@@ -0,0 +1,79 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include "scene.hpp"
+
+#include <vector>
+
+// Caixa alinhada aos eixos.
+struct AABB {
+  vec3 lo, hi;
+  AABB() : lo(1e30f), hi(-1e30f) {}
+  AABB(vec3 lo, vec3 hi) : lo(lo), hi(hi) {}
+  void extend(const AABB& b) {lo = min(lo, b.lo); hi = max(hi, b.hi);}
+  vec3 center() const {return 0.5f*(lo + hi);}
+  // Distância de p até a caixa (zero no interior), igual à bound() do shader.
+  float distance(vec3 p) const {return length(max(max(lo - p, p - hi), 0.0f));}
+};
+
+// Caixa envolvente conservadora de um objeto. Retorna false para objetos
+// ilimitados (poliedros, cones) ou de extensão desconhecida (externos).
+bool primitiveBounds(const ScenePrimitive& object, AABB& box);
+
+// Nó da hierarquia: nós internos têm dois filhos; folhas guardam um
+// intervalo de BVH::primitives().
+struct BVHNode {
+  AABB box;
+  int left, right;   // índices dos filhos (-1 nas folhas)
+  int first, count;  // intervalo de objetos das folhas
+};
+
+// Hierarquia de volumes envolventes sobre os objetos limitados da cena. O
+// map() gerado só avalia uma subárvore se a distância até a sua caixa for
+// menor que a menor distância encontrada até o momento.
+class BVH {
+ public:
+  BVH(const std::vector<ScenePrimitive>& objects, int leafSize = 2);
+  const std::vector<BVHNode>& nodes() const {return m_nodes;}          // raiz em 0
+  const std::vector<int>& primitives() const {return m_primitives;}    // objetos das folhas
+  const std::vector<int>& unbounded() const {return m_unbounded;}      // sempre avaliados
+
+ private:
+  int build(int first, int last);
+
+  std::vector<BVHNode> m_nodes;
+  std::vector<int> m_primitives, m_unbounded;
+  std::vector<AABB> m_bounds;  // caixa de cada objeto da cena
+  int m_leafSize;
+};
+
+// Triângulo pronto para a interseção de Möller-Trumbore: um vértice e as
+// duas arestas que partem dele.
+struct MeshTriangle {
+  vec3 v0, e1, e2;
+  int object;        // objeto da cena (material e propriedade)
+};
+
+// Hierarquia sobre os triângulos de todas as malhas da cena, construída
+// com a heurística de área de superfície (SAH) em intervalos. O filho
+// esquerdo de um nó interno é sempre o nó seguinte, e as folhas apontam
+// para intervalos contíguos de triangles().
+class TriangleBVH {
+ public:
+  TriangleBVH(const std::vector<SceneMesh>& meshes, int leafSize = 4);
+  const std::vector<BVHNode>& nodes() const {return m_nodes;}             // raiz em 0
+  const std::vector<MeshTriangle>& triangles() const {return m_triangles;} // na ordem das folhas
+  int depth() const {return m_depth;}
+
+ private:
+  int build(int first, int last, int depth);
+
+  std::vector<BVHNode> m_nodes;
+  std::vector<MeshTriangle> m_triangles;
+  std::vector<AABB> m_bounds;  // caixa de cada triângulo
+  std::vector<vec3> m_centers;
+  std::vector<int> m_order;    // triângulos na ordem das folhas
+  int m_leafSize, m_depth;
+};
+
+#endif // BVH_HPP
@@ -0,0 +1,28 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <vector>
+
+// Estado de uma renderização progressiva, suficiente para continuá-la de
+// onde parou. O gerador de números aleatórios de cada amostra depende só do
+// número da amostra, então o próximo índice (samples) é todo o seu estado.
+struct Checkpoint {
+  enum Backend {GPU = 0, CPU = 1};
+
+  int backend;            // a GPU guarda a média; a CPU, a soma das amostras
+  unsigned int width, height;
+  unsigned int samples;   // amostras acumuladas (próxima amostra a calcular)
+  unsigned long long sceneHash;
+  std::vector<float> data; // RGB float, linhas de baixo para cima
+  std::vector<float> moments; // por pixel: segundo momento da luminância
+                              // (média ou soma), amostras e erro estimado
+
+  void save(const std::string& path) const;
+  void load(const std::string& path);
+};
+
+// Identifica a cena pelo conteúdo do arquivo de entrada.
+unsigned long long sceneHash(const std::string& sceneFile);
+
+#endif // CHECKPOINT_HPP
@@ -0,0 +1,56 @@
+#ifndef CPU_RENDERER_HPP
+#define CPU_RENDERER_HPP
+
+#include "scene.hpp"
+#include "bvh.hpp"
+#include "parser.hpp"
+#include "sobol.hpp"
+#include "distance_field.hpp"
+
+#include <vector>
+
+// Backend de referência em CPU. Executa o mesmo algoritmo do raytrace() do
+// template.glsl sobre a cena do Parser, dividindo a imagem em blocos que
+// são distribuídos entre as threads com roubo de trabalho.
+class CpuRenderer {
+ public:
+  CpuRenderer(const Scene& scene, int width, int height, int threads = 0);
+  void render(unsigned int samples);
+  void bakeField(int resolution);
+  const DistanceField& getField() const {return m_field;}
+  std::vector<float> getImage() const;
+  const std::vector<float>& getSum() const {return m_sum;}
+  std::vector<float> getMoments() const;
+  void getAuxiliary(std::vector<float>& moments, std::vector<float>& albedo, std::vector<float>& normal) const;
+  void resume(const std::vector<float>& sum, const std::vector<float>& moments, unsigned int samples);
+  void setAdaptive(float threshold, unsigned int minSamples) {m_adaptive = threshold; m_adaptiveMin = minSamples;}
+  bool converged() const {return m_converged;}
+  unsigned int getSamples() const {return m_samples;}
+  int getThreads() const {return m_threads;}
+
+ private:
+  void renderTile(int tile, unsigned int count);
+  float pixelError(int pixel) const;
+
+  Scene m_scene;
+  BVH m_bvh;                     // hierarquia sobre m_scene.objects
+  TriangleBVH m_meshBVH;         // hierarquia sobre m_scene.meshes
+  DistanceField m_field;         // campo pré-calculado (vazio sem bakeField)
+  std::vector<Image> m_images;   // texturas indexadas como iChannel[i-2]
+  std::vector<uint32_t> m_sobol; // matrizes geradoras do amostrador
+  std::vector<float> m_lightPDF; // probabilidade de escolha de cada luz
+  std::vector<LightAlias> m_lightTable; // tabela de alias sobre m_lightPDF
+  std::vector<float> m_sum;      // soma das amostras (RGB)
+  std::vector<float> m_sum2;     // soma dos quadrados da luminância
+  std::vector<unsigned int> m_count; // amostras de cada pixel
+  std::vector<float> m_albedo;   // soma do albedo e amostras (denoiser)
+  std::vector<float> m_normal;   // soma da normal e da profundidade
+  int m_width, m_height, m_threads;
+  int m_tilesX, m_tilesY;
+  unsigned int m_samples;        // número de amostras acumuladas
+  float m_adaptive;              // erro relativo para parar um pixel (0 desliga)
+  unsigned int m_adaptiveMin;    // amostras antes de estimar o erro
+  bool m_converged;              // todos os pixels atingiram m_adaptive
+};
+
+#endif // CPU_RENDERER_HPP
@@ -0,0 +1,24 @@
+#ifndef DENOISER_HPP
+#define DENOISER_HPP
+
+#include <vector>
+
+// Parâmetros do filtro, enviados também ao denoise.glsl pelo Renderer.
+#define DENOISE_ITERATIONS 4      // passos do à-trous (distâncias 1, 2, 4, 8)
+#define DENOISE_SIGMA_LUMINANCE 2.0f // em desvios padrão da média do pixel
+#define DENOISE_SIGMA_NORMAL 0.1f
+#define DENOISE_SIGMA_DEPTH 0.005f // diferença relativa por pixel de distância
+#define DENOISE_ALBEDO_FLOOR 0.01f
+
+// Filtro à-trous guiado por arestas (Dammertz et al., 2010), a mesma conta
+// do denoise.glsl. A iluminação (cor sobre albedo) é filtrada com pesos de
+// normal, profundidade e luminância, esta relativa ao desvio padrão da
+// média de cada pixel, de modo que imagens já convergidas quase não mudam.
+// Entradas com linhas de baixo para cima, no formato dos buffers do
+// Renderer: média RGB; momentos (E[L²], amostras, erro); soma do albedo e
+// número de amostras; soma da normal e da profundidade.
+std::vector<float> denoise(const std::vector<float>& image, const std::vector<float>& moments,
+                           const std::vector<float>& albedo, const std::vector<float>& normal,
+                           int width, int height);
+
+#endif // DENOISER_HPP
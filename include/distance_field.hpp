@@ -0,0 +1,65 @@
+#ifndef DISTANCE_FIELD_HPP
+#define DISTANCE_FIELD_HPP
+
+#include "scene.hpp"
+
+#include <vector>
+#include <functional>
+
+// Amostras por eixo de cada bloco fino, incluindo as duas faces da célula
+// (FIELD_BRICK no field.glsl).
+#define FIELD_BRICK 8
+
+// Erro máximo da interpolação trilinear, em lados de célula: meia diagonal
+// (sqrt(3)/2), com folga para a precisão dos pesos do filtro linear das
+// GPUs (FIELD_MARGIN no field.glsl).
+#define FIELD_MARGIN 0.9f
+
+// Avalia o map() da cena em um lote de pontos. O Renderer usa o próprio
+// shader gerado; o CpuRenderer, a transcrição em C++.
+typedef std::function<void(const std::vector<vec3>& points, std::vector<float>& distances)>
+  FieldEvaluator;
+
+// Campo de distância pré-calculado em dois níveis. Uma grade grossa guarda
+// o map() nos vértices das células; as células que podem estar perto da
+// superfície ganham um bloco de FIELD_BRICK³ amostras mais finas. Para uma
+// função 1-Lipschitz, o valor interpolado menos a margem do nível é um
+// limite inferior seguro para os passos da marcha.
+class DistanceField {
+ public:
+  DistanceField() : m_cell(0), m_brickCount(0) {}
+  void bake(const Scene& scene, int resolution, const FieldEvaluator& evaluate);
+  bool empty() const {return m_coarse.empty();}
+
+  // Distância interpolada e margem de cada nível em p. Retornam false fora
+  // da grade (onde vale o map() exato) e, no nível fino, nas células sem
+  // bloco.
+  bool coarseSample(vec3 p, float& d, float& margin) const;
+  bool fineSample(vec3 p, float& d, float& margin) const;
+
+  vec3 lo() const {return m_lo;}                              // canto da grade
+  float cell() const {return m_cell;}                         // lado das células
+  const int *cells() const {return m_cells;}                  // células por eixo
+  const int *atlas() const {return m_atlas;}                  // blocos por eixo do atlas
+  const std::vector<float>& coarse() const {return m_coarse;} // (cells+1)³ amostras
+  const std::vector<int>& index() const {return m_index;}     // bloco de cada célula, ou -1
+  const std::vector<float>& bricks() const {return m_bricks;} // blocos contíguos, x mais rápido
+  int brickCount() const {return m_brickCount;}
+  std::vector<float> atlasTexels() const;                     // blocos dispostos no atlas
+  size_t bytes() const;                                       // memória das três texturas
+
+ private:
+  int cellIndex(int x, int y, int z) const {return (z * m_cells[1] + y) * m_cells[0] + x;}
+  bool locate(vec3 p, vec3& q) const;
+  static float trilinear(const float *data, int sx, int sy, int x, int y, int z, vec3 f);
+
+  vec3 m_lo;
+  float m_cell;
+  int m_cells[3], m_atlas[3];
+  std::vector<float> m_coarse;
+  std::vector<int> m_index;
+  std::vector<float> m_bricks;
+  int m_brickCount;
+};
+
+#endif // DISTANCE_FIELD_HPP
@@ -0,0 +1,68 @@
+#ifndef FRAME_STATS_HPP
+#define FRAME_STATS_HPP
+
+#include <string>
+#include <deque>
+#include <fstream>
+#include <chrono>
+
+// Estatísticas por quadro (um envio no modo sem janela): tempo de GPU de
+// cada etapa, vindo das consultas GL_TIME_ELAPSED do Renderer, tempo de
+// CPU gasto nos envios e amostras calculadas. Como as consultas chegam
+// alguns quadros depois, cada quadro só é gravado quando todas as etapas
+// medidas já têm resultado. A saída é CSV ou JSON, conforme a extensão;
+// "-" escreve o CSV na saída padrão, e as demais mensagens vão para o
+// stderr (ver reserveStdout).
+class FrameStats {
+ public:
+  enum Stage {TRACE = 0, DENOISE, BLIT, STAGES};
+
+  FrameStats() : m_enabled(false), m_json(false), m_fd(-1), m_frame(0), m_width(0),
+                 m_height(0), m_rows(0), m_gpuMs(), m_measured(), m_cpuMs(0.0), m_work(0.0),
+                 m_timedWork(0.0) {};
+  void open(const std::string& path, const std::string& renderer, int width, int height);
+
+  // Guarda a saída padrão para o CSV de "-" e manda para o stderr tudo o
+  // que for escrito depois no std::cout. Chamada antes das primeiras
+  // mensagens do programa; open("-") a chama se ainda não foi chamada.
+  static void reserveStdout();
+  bool enabled() const {return m_enabled;}
+  unsigned int frame() const {return m_frame;}
+  void beginFrame();
+  void addWork(double work) {m_current.work += work;}
+  void timed(Stage stage) {m_current.pending++; m_current.gpuMs[stage] = 0.0;}
+  void endFrame(unsigned int samples);
+  void gpuTime(unsigned int frame, Stage stage, double ms);
+  void finish();
+
+ private:
+  struct Frame {
+    unsigned int id;
+    unsigned int samples; // amostras acumuladas ao fim do quadro
+    double work;          // amostras de pixel (raios de câmera) enviadas
+    double cpuMs;
+    double gpuMs[STAGES]; // negativo quando a etapa não foi medida
+    int pending;          // consultas ainda sem resultado
+  };
+  typedef std::chrono::steady_clock Clock;
+
+  void flush(bool all);
+  void write(const Frame& frame);
+  void output(const std::string& text);
+
+  bool m_enabled, m_json;
+  std::ofstream m_file;
+  int m_fd;                // saída padrão reservada, com "-"
+  unsigned int m_frame;    // identificador do quadro em andamento
+  int m_width, m_height;
+  unsigned int m_rows;     // quadros já gravados
+  Frame m_current;
+  Clock::time_point m_start, m_begin;
+  std::deque<Frame> m_frames; // quadros à espera das consultas
+  double m_gpuMs[STAGES];  // totais de cada etapa nos quadros medidos
+  unsigned int m_measured[STAGES];
+  double m_cpuMs, m_work;
+  double m_timedWork;      // trabalho dos quadros com o traçado medido
+};
+
+#endif // FRAME_STATS_HPP
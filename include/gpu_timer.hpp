@@ -0,0 +1,27 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <vector>
+#include <GL/glew.h>
+
+// Mede o tempo de GPU com GL_TIME_ELAPSED sem bloquear a CPU: as consultas
+// ficam em um anel e são lidas alguns quadros depois, quando prontas. Cada
+// consulta carrega a quantidade de trabalho medida (ex.: amostras de pixel)
+// e uma marca livre (ex.: o quadro a que pertence).
+class GpuTimer {
+ public:
+  GpuTimer() : m_head(0), m_tail(0) {};
+  void init(int size = 4);
+  bool begin(double work, unsigned int tag = 0);
+  void end();
+  bool poll(double& ms, double& work, unsigned int& tag);
+  void destroy();
+
+ private:
+  std::vector<GLuint> m_queries;
+  std::vector<double> m_work;
+  std::vector<unsigned int> m_tags;
+  unsigned int m_head, m_tail; // consultas em [m_tail, m_head) estão pendentes
+};
+
+#endif // GPU_TIMER_HPP
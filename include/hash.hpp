@@ -0,0 +1,16 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <string>
+
+// FNV-1a de 64 bits, usado para identificar cenas e shaders em arquivos
+// gravados em disco (cache de programas, checkpoints).
+inline unsigned long long fnv1a(const std::string& s, unsigned long long h = 14695981039346656037ULL) {
+  for (size_t i = 0; i < s.size(); ++i) {
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+#endif // HASH_HPP
@@ -0,0 +1,59 @@
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+#include "vecmath.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+// Grava a imagem acumulada (RGB float, linhas de baixo para cima como na
+// OpenGL). O formato vem da extensão do arquivo: .pfm, .hdr e .exr guardam
+// a radiância sem perdas; .ppm aplica o mesmo tonemapping do blit.glsl.
+class ImageWriter {
+ public:
+  ImageWriter(const std::string& path) : m_path(path) {};
+  void write(const std::vector<float>& rgb, int width, int height);
+  static bool supported(const std::string& path);
+
+ private:
+  void writePFM(const std::vector<float>& rgb, int width, int height);
+  void writeHDR(const std::vector<float>& rgb, int width, int height);
+  void writeEXR(const std::vector<float>& rgb, int width, int height);
+  void writePPM(const std::vector<float>& rgb, int width, int height);
+
+  std::string m_path;
+};
+
+// Grava imagens (ou executa outras escritas, como checkpoints) em uma
+// thread própria, para que o laço de renderização nunca espere pelo disco.
+// Erros de escrita são apenas reportados.
+class AsyncImageWriter {
+ public:
+  AsyncImageWriter() : m_done(false) {};
+  ~AsyncImageWriter() {finish();}
+  void push(const std::string& path, std::vector<float>& rgb, int width, int height);
+  void push(const std::function<void()>& job);
+  void finish();
+
+ private:
+  void run();
+
+  std::deque<std::function<void()> > m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread m_thread;
+  bool m_done;
+};
+
+// Insere o número de amostras antes da extensão: out.exr -> out_000256.exr
+std::string snapshotPath(const std::string& path, unsigned int samples);
+
+// Tonemapping do blit.glsl (Uncharted 2 com correção gamma 2.2).
+vec3 tonemap(vec3 color);
+
+#endif // IMAGE_WRITER_HPP
@@ -1,35 +1,35 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include "scene.hpp"
+
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <sstream>
-#include <tuple>
 
-// Parser para ler o arquivo de entrada e gerar um shader
+class Tokenizer;
+
+// Parser para ler o arquivo de entrada e montar a cena em memória. O código
+// do shader é gerado a partir dela pelo ShaderGenerator.
 class Parser {
  public:
   Parser(const std::string& file);
-  int getLights() {return m_lights;};
   std::vector<std::string> getTextures() {return m_textures;}
-  std::string read();
+  const Scene& getScene() const {return m_scene;}
+  void read();
   
  private:
-  std::string readCamera(std::ifstream& input);
-  std::string readLights(std::ifstream& input);
-  std::string readMaterials(std::ifstream& input);
-  std::string readProperties(std::ifstream& input);
-  void readObjects(std::ifstream& input, std::string& objects, std::string& materialSelection, std::string& lights);
-  void writeMaterial(std::stringstream& ss, int id1, int id2);
+  void readCamera(Tokenizer& input);
+  void readLights(Tokenizer& input);
+  void readMaterials(Tokenizer& input);
+  void readProperties(Tokenizer& input);
+  void readObjects(Tokenizer& input);
+  vec3 readVec3(Tokenizer& input);
+  int readCount(Tokenizer& input);
+  void readParams(Tokenizer& input, ScenePrimitive& object, int count);
   
   std::string m_file, m_root_dir;
-  int m_lights;
-  std::unordered_map<int, std::tuple<float,float,float> > lightColor;
-  std::unordered_map<int, bool> isLight;
-  std::unordered_map<int,int> typeHash, colorHash, checkerHash, texHash;
   std::vector<std::string> m_textures;
-  std::stringstream externalObjects;
+  Scene m_scene;
 };
 
 // Classe simples que carrega um único shader em uma string
@@ -42,6 +42,34 @@ class ShaderReader {
   std::string m_path;
 };
 
+// Imagem RGB de 8 bits por canal
+struct Image {
+  unsigned int width, height;
+  std::vector<unsigned char> data;
+};
+
+// Leitor de arquivos PPM (P6)
+class PPMReader {
+ public:
+  PPMReader(const std::string& path) : m_path(path) {};
+  Image read();
+
+ private:
+  std::string m_path;
+};
+
+// Leitor de malhas no formato Wavefront OBJ. Só os vértices (v) e as faces
+// (f) são usados; as faces com mais de três vértices viram leques de
+// triângulos e as demais linhas são ignoradas.
+class ObjReader {
+ public:
+  ObjReader(const std::string& path) : m_path(path) {};
+  void read(SceneMesh& mesh);
+
+ private:
+  std::string m_path;
+};
+
 // Carregador de texturas
 class TextureLoader {
 public:
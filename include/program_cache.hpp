@@ -0,0 +1,26 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <string>
+#include <GL/glew.h>
+
+// Cache em disco dos binários de programas (glGetProgramBinary). A chave é
+// um hash do código-fonte final junto com fabricante, renderizador e versão
+// do driver, de modo que uma troca de driver invalida as entradas antigas.
+class ProgramCache {
+ public:
+  ProgramCache();
+  void setEnabled(bool enabled) {m_enabled = enabled;}
+  bool isEnabled() const;
+  std::string key(const std::string& vertex, const std::string& fragment) const;
+  GLuint load(const std::string& key) const;
+  void store(const std::string& key, GLuint program) const;
+
+ private:
+  std::string path(const std::string& key) const;
+
+  std::string m_dir;   // diretório das entradas (vazio = sem cache)
+  bool m_enabled;
+};
+
+#endif // PROGRAM_CACHE_HPP
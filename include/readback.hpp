@@ -0,0 +1,29 @@
+#ifndef READBACK_HPP
+#define READBACK_HPP
+
+#include <vector>
+#include <GL/glew.h>
+
+// Leitura assíncrona do buffer de acumulação: cada pedido copia o frame
+// buffer para um pixel buffer object de um anel e insere uma fence. A cópia
+// para a memória da CPU só acontece quando a fence já foi sinalizada, de
+// modo que a GPU continua calculando amostras enquanto isso.
+class Readback {
+ public:
+  Readback() : m_width(0), m_height(0), m_attachments(1), m_head(0), m_tail(0) {};
+  void init(GLint width, GLint height, int size = 3, int attachments = 1);
+  void request(GLuint fbo, unsigned int tag);
+  bool poll(std::vector<float>& image, unsigned int& tag, bool wait = false);
+  bool full() const {return m_head - m_tail == m_buffers.size();}
+  void destroy();
+
+ private:
+  std::vector<GLuint> m_buffers;
+  std::vector<GLsync> m_fences;
+  std::vector<unsigned int> m_tags;
+  GLint m_width, m_height;
+  int m_attachments;         // anexos RGB lidos em cada pedido
+  unsigned int m_head, m_tail; // leituras em [m_tail, m_head) estão pendentes
+};
+
+#endif // READBACK_HPP
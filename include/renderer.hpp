@@ -1,31 +1,148 @@
 #ifndef RENDERER_HPP
 #define RENDERER_HPP
 
+#include "gpu_timer.hpp"
+#include "frame_stats.hpp"
+#include "program_cache.hpp"
+#include "readback.hpp"
+#include "image_writer.hpp"
+#include "checkpoint.hpp"
+#include "scene.hpp"
+#include "distance_field.hpp"
+
 #include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#ifdef HAVE_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#endif
 
 class Renderer {
  public:
-  Renderer() : m_time(-1) {};
-  Renderer(float time) : m_time(time) {};
+  Renderer() : Renderer(-1.0f) {}
+  Renderer(float time) : m_window(NULL), m_headless(false), m_samples(0), m_passSamples(0),
+                         m_frameTime(16.0f), m_tileSize(256), m_fbo(), m_accum(), m_moments(), m_sceneUBO(0), m_meshBuffers(), m_meshTextures(), m_fieldTextures(),
+                         m_snapshotEvery(0), m_checkpointEvery(0), m_sceneHash(0), m_startSamples(0), m_stopSamples(0), m_lastRead(0), m_adaptive(0.0f),
+                         m_adaptiveMin(32), m_lastCheck(0), m_convergedPixels(0), m_stencil(0), m_convergeProgram(0),
+                         m_denoise(false), m_aux(), m_filter(), m_filterFBO(), m_denoiseProgram(0),
+                         m_renderTime(0.0), m_renderedSamples(0), m_time(time) {};
   void setupWindow(int width, int height);
-  void setupProgram(const std::string& vertex, const std::string& fragment, const std::string& blit);
+  void setupHeadless(int width, int height);
+  void setupProgram(const std::string& vertex, const std::string& fragment, const std::string& blit,
+                    const std::string& converge, const std::string& denoise);
   void render();
   void terminate();
-  void setLights(GLint lights) {m_lights = lights;}
+  void uploadScene(const Scene& scene);
+  void bakeField(DistanceField& field, const Scene& scene, int resolution,
+                 const std::string& vertex, const std::string& fragment);
+  std::vector<float> readImage();
+  void readAuxiliary(std::vector<float>& moments, std::vector<float>& albedo, std::vector<float>& normal);
+  void setSamples(GLuint samples) {m_samples = samples;}
+  void setSamplesPerPass(GLuint samples) {m_passSamples = samples;}
+  void setFrameTime(float ms) {m_frameTime = ms;}
+  void setTileSize(GLint size) {m_tileSize = size;}
+  void setProgramCache(bool enabled) {m_cache.setEnabled(enabled);}
+  void setSnapshots(GLuint every, const std::string& path) {m_snapshotEvery = every; m_snapshotPath = path;}
+  void setCheckpoint(GLuint every, const std::string& path, unsigned long long sceneHash);
+  void resume(const Checkpoint& checkpoint);
+  void setAdaptive(float threshold, GLuint minSamples) {m_adaptive = threshold; m_adaptiveMin = minSamples;}
+  void setDenoise(bool enabled) {m_denoise = enabled;}
+  void setStats(const std::string& path);
+  // Resultados do modo sem janela, usados pelo pathtracer-bench.
+  std::chrono::steady_clock::time_point getFirstSampleTime() const {return m_firstSample;}
+  double getRenderTime() const {return m_renderTime;}
+  GLuint getRenderedSamples() const {return m_renderedSamples;}
   static bool scapeKey;
   
  private:
   void setupFBO();
+  void setupUniforms();
+  void uploadMeshes(const std::vector<SceneMesh>& meshes);
+  void uploadField(const DistanceField& field);
+  GLuint renderStep(GLuint maxSamples, float time);
+  GLint tilePixels(GLint t) const;
+  bool converged() const;
+  void markConverged();
+  void pollConverged();
+  void finishPass(GLuint N);
+  void updateWorkBudget();
+  bool beginStage(FrameStats::Stage stage);
+  void endStage(FrameStats::Stage stage);
+  void pollStages();
+  void finishStats();
+  GLuint passLimit(GLuint N, GLuint total) const;
+  bool wantsReadback(GLuint N) const;
+  void requestReadback(GLuint N);
+  void collectSnapshots(bool wait);
+  void deliverReadback(std::vector<float>& image, GLuint samples);
+  GLuint denoiseImage();
+  void blit(GLuint texture);
+  void renderHeadless();
   GLuint compileShader(GLenum type, const std::string& shader) const;
   GLuint linkShaders(GLuint vertex, GLuint fragment) const;
+  GLuint buildProgram(const std::string& vertex, const std::string& fragment) const;
   
   GLFWwindow *m_window;      // janela da glfw
+#ifdef HAVE_EGL
+  EGLDisplay m_display;      // contexto offscreen (modo sem janela)
+  EGLContext m_context;
+#endif
+  bool m_headless;           // renderiza sem janela nem swap chain
+  GLuint m_samples;          // amostras a calcular no modo sem janela
+  GLuint m_passSamples;      // amostras por passo (0 = automático)
+  GLuint m_passCount;        // amostras do passo em andamento
+  float m_frameTime;         // tempo de GPU desejado por envio (ms)
+  double m_work;             // orçamento de cada envio (amostras de pixel)
+  GpuTimer m_timer;          // mede o tempo de cada envio
+  GpuTimer m_stageTimer;     // denoiser e blit, só com estatísticas
+  FrameStats m_stats;        // estatísticas por quadro (--stats)
+  GLint m_tileSize;          // lado dos blocos (pixels)
+  GLint m_tilesX, m_tilesY;  // número de blocos em cada direção
+  GLint m_nextTile;          // próximo bloco do passo em andamento
+  GLint m_timeLoc, m_passLoc; // uniforms atualizados a cada passo
   GLuint m_mainProgram, m_blitProgram, m_vbo; // glProgram e array buffer
-  GLuint m_fbo;              // frame buffer object
+  GLuint m_fbo[2];           // frame buffers de acumulação (ping-pong)
+  GLuint m_accum[2];         // texturas RGB32F de acumulação
+  GLuint m_moments[2];       // E[L²], amostras e erro de cada pixel
+  int m_current;             // índice do buffer com a última amostra
   GLint m_width, m_height;   // largura e altura da viewport
-  GLint m_lights;            // quantidade de luzes na cena
+  GLuint m_sceneUBO;         // luzes e materiais (bloco SceneData)
+  GLuint m_meshBuffers[2];   // nós e triângulos da TriangleBVH (mesh.glsl)
+  GLuint m_meshTextures[2];  // buffer textures sobre m_meshBuffers
+  GLuint m_fieldTextures[3]; // campo de distância: grade grossa, índices e blocos
+  ProgramCache m_cache;      // binários de programas já compilados
+  GLuint m_snapshotEvery;    // intervalo (em amostras) entre imagens parciais
+  std::string m_snapshotPath;
+  Readback m_readback;       // leituras assíncronas das imagens parciais
+  AsyncImageWriter m_writer; // grava as imagens parciais e checkpoints fora do laço
+  GLuint m_checkpointEvery;  // intervalo (em amostras) entre checkpoints
+  std::string m_checkpointPath;
+  unsigned long long m_sceneHash;
+  GLuint m_startSamples;     // amostras já acumuladas ao retomar
+  std::vector<float> m_startImage; // média lida do checkpoint
+  std::vector<float> m_startMoments;
+  GLuint m_stopSamples;      // amostras ao final do modo sem janela
+  GLuint m_lastRead;         // amostras na última leitura pedida
+  float m_adaptive;          // erro relativo para parar um pixel (0 desliga)
+  GLuint m_adaptiveMin;      // amostras antes de estimar o erro
+  GLuint m_lastCheck;        // amostras na última marcação de convergência
+  GLint64 m_convergedPixels; // pixels já marcados no stencil
+  std::deque<GLuint> m_convergeQueries; // occlusion queries pendentes
+  GLuint m_stencil;          // stencil compartilhado pelos dois frame buffers
+  GLuint m_convergeProgram;  // marca os pixels convergidos (converge.glsl)
+  bool m_denoise;            // filtra a imagem exibida (denoise.glsl)
+  GLuint m_aux[2];           // somas do albedo e da normal/profundidade
+  GLuint m_filter[2];        // ping-pong dos passos do filtro
+  GLuint m_filterFBO[2];
+  GLuint m_denoiseProgram;
+  std::chrono::steady_clock::time_point m_firstSample; // fim do primeiro passo
+  double m_renderTime;       // duração do modo sem janela (s)
+  GLuint m_renderedSamples;  // amostras calculadas (sem as do checkpoint)
   float m_time;              // tempo da simulacao para renderizacoes estaticas
 };
 
@@ -0,0 +1,83 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include "vecmath.hpp"
+
+#include <string>
+#include <vector>
+
+// Representação em memória da cena lida pelo Parser. É a mesma informação
+// que vai para o shader gerado, mas em forma de dados para que outros
+// backends (CPU) possam consumi-la.
+
+struct SceneCamera {
+  vec3 position, target, up;
+  float fov;
+};
+
+struct SceneLight {
+  int type;       // 0 = pontual, 1 = esfera
+  vec3 position, color;
+  float radius;
+};
+
+struct SceneMaterial {
+  int type;       // 0 = sólido, 1 = xadrez, 2 = textura
+  int index;      // índice dentro do array do tipo (igual ao shader)
+  vec3 colorA, colorB;
+  float size;     // tamanho do xadrez ou escala da textura
+  std::string texture;
+};
+
+struct SceneProperties {
+  vec3 emission;
+  float alpha, kr, kt, ior;
+};
+
+enum PrimitiveType {
+  PRIMITIVE_SPHERE, PRIMITIVE_POLYHEDRON, PRIMITIVE_BOX, PRIMITIVE_TORUS,
+  PRIMITIVE_CONE, PRIMITIVE_CYLINDER, PRIMITIVE_DISK, PRIMITIVE_CUSTOM,
+  PRIMITIVE_MESH
+};
+
+struct ScenePrimitive {
+  PrimitiveType type;
+  int material, property;
+  std::vector<float> params; // parâmetros na ordem do arquivo de cena
+  std::string name;          // nome do shader para objetos externos ou
+                             // arquivo .obj das malhas
+};
+
+// Malha de triângulos lida de um arquivo .obj. Não entra no map(): os
+// raios a interceptam analiticamente (ver TriangleBVH).
+struct SceneMesh {
+  int object;                // índice do objeto em Scene::objects
+  std::vector<vec3> vertices;
+  std::vector<int> indices;  // três vértices por triângulo
+};
+
+struct Scene {
+  SceneCamera camera;
+  std::vector<SceneLight> lights;
+  std::vector<SceneMaterial> materials;
+  std::vector<SceneProperties> properties;
+  std::vector<ScenePrimitive> objects;
+  std::vector<SceneMesh> meshes;
+};
+
+// Probabilidade de cada luz ser escolhida na iluminação direta,
+// proporcional à potência emitida.
+std::vector<float> lightDistribution(const std::vector<SceneLight>& lights);
+
+// Entrada da tabela de alias (Walker) sobre essa distribuição: sorteada a
+// coluna i uniformemente, fica-se com i se a fração restante do número
+// sorteado for menor que probability, ou troca-se por alias.
+struct LightAlias {
+  float probability;
+  int alias;
+};
+
+// Tabela montada pelo método de Vose, com uma coluna por luz.
+std::vector<LightAlias> lightAliasTable(const std::vector<float>& pdf);
+
+#endif // SCENE_HPP
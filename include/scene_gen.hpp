@@ -0,0 +1,26 @@
+#ifndef SCENE_GEN_HPP
+#define SCENE_GEN_HPP
+
+#include <ostream>
+
+// Formas e acabamentos sorteados pelo gerador, na ordem dos pesos.
+enum GenShape {GEN_SPHERE = 0, GEN_BOX, GEN_TORUS, GEN_POLYHEDRON, GEN_SHAPES};
+enum GenFinish {GEN_DIFFUSE = 0, GEN_GLOSSY, GEN_MIRROR, GEN_GLASS, GEN_FINISHES};
+
+struct SceneGenOptions {
+  int objects;                 // primitivas sorteadas (sem o chão e as luzes)
+  int emissive;                // esferas emissivas; sem nenhuma, uma luz pontual
+  unsigned int seed;
+  float shapes[GEN_SHAPES];    // pesos relativos de cada forma
+  float finishes[GEN_FINISHES];// pesos relativos de cada acabamento
+
+  SceneGenOptions();
+};
+
+// Escreve uma cena .in com os objetos sobre uma grade no chão (eixo y para
+// cima) e a câmera enquadrando a grade inteira. A mesma semente gera
+// sempre o mesmo arquivo. Os poliedros do formato são uniões de
+// semiespaços, sem limite, e por isso viram paredes ao redor da grade.
+void generateScene(const SceneGenOptions& options, std::ostream& out);
+
+#endif // SCENE_GEN_HPP
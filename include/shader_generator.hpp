@@ -0,0 +1,40 @@
+#ifndef SHADER_GENERATOR_HPP
+#define SHADER_GENERATOR_HPP
+
+#include "scene.hpp"
+#include "bvh.hpp"
+
+#include <string>
+#include <sstream>
+
+// Gera as funções GLSL dependentes da cena (buildCamera, map, mapMat,
+// calcNormal, traceMesh e fieldMap) a partir da representação lida pelo
+// Parser. O resultado é concatenado ao template.glsl. Os objetos limitados
+// são percorridos por uma BVH, gerada como ifs aninhados sobre a distância
+// até cada caixa; as malhas ficam fora do map() e usam a TriangleBVH. Com
+// field, a marcha lê o campo de distância pré-calculado (field.glsl).
+class ShaderGenerator {
+ public:
+  ShaderGenerator(const Scene& scene, bool field = false)
+    : m_scene(scene), m_bvh(scene.objects), m_field(field) {};
+  std::string generate() const;
+
+ private:
+  std::string camera() const;
+  std::string externalObjects() const;
+  std::string map() const;
+  std::string mapMat() const;
+  std::string normals() const;
+  std::string meshes() const;
+  std::string field() const;
+  std::string normal(const ScenePrimitive& object) const;
+  std::string distance(const ScenePrimitive& object) const;
+  void writeObject(std::stringstream& ss, int id, bool select) const;
+  void writeNode(std::stringstream& ss, int node, bool select) const;
+
+  const Scene& m_scene;
+  BVH m_bvh;
+  bool m_field;
+};
+
+#endif // SHADER_GENERATOR_HPP
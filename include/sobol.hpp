@@ -0,0 +1,15 @@
+#ifndef SOBOL_HPP
+#define SOBOL_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Número de dimensões da sequência de Sobol usadas pelo amostrador. Deve ser
+// igual ao tamanho de sobolMatrix (32 colunas por dimensão) no template.glsl.
+#define SOBOL_DIMENSIONS 2
+
+// Matrizes geradoras de Sobol (32 colunas por dimensão), com os números de
+// direção de Joe e Kuo. A dimensão 0 é a sequência de van der Corput.
+std::vector<uint32_t> sobolMatrices(int dimensions = SOBOL_DIMENSIONS);
+
+#endif // SOBOL_HPP
@@ -0,0 +1,49 @@
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+
+#include <string>
+#include <cstring>
+
+// Trecho do arquivo entre espaços em branco. Aponta para o próprio
+// mapeamento do arquivo, sem cópia; só vale enquanto o Tokenizer existir.
+struct Token {
+  const char *begin;
+  size_t size;
+  int line, column;
+
+  bool operator==(const char *s) const {return strlen(s) == size && !memcmp(begin, s, size);}
+  bool operator!=(const char *s) const {return !(*this == s);}
+  std::string str() const {return std::string(begin, size);}
+};
+
+// Lê o arquivo de cena mapeado em memória, token a token. Os números são
+// convertidos direto do mapeamento, sem passar por std::string nem por
+// iostreams. Erros de sintaxe lançam std::runtime_error com o arquivo, a
+// linha e a coluna do token.
+class Tokenizer {
+ public:
+  Tokenizer(const std::string& file);
+  ~Tokenizer();
+
+  Token word();          // próximo token, qualquer que seja
+  float number();        // próximo token, que deve ser um número real
+  int integer(Token *where = NULL); // próximo token, que deve ser um inteiro
+  bool atEnd();          // só restam espaços em branco
+  bool atLineEnd();      // não há mais tokens na linha atual
+  void skipLine();       // descarta o resto da linha atual
+
+  void error(const Token& token, const std::string& message) const;
+
+ private:
+  Tokenizer(const Tokenizer&);
+  Tokenizer& operator=(const Tokenizer&);
+  void skipSpaces();
+
+  std::string m_file;
+  const char *m_data, *m_pos, *m_end;
+  size_t m_size;          // tamanho do mapeamento (0 para arquivo vazio)
+  int m_line;
+  const char *m_lineStart;
+};
+
+#endif // TOKENIZER_HPP
@@ -0,0 +1,88 @@
+#ifndef VECMATH_HPP
+#define VECMATH_HPP
+
+#include <cmath>
+#include <algorithm>
+
+// Vetores no estilo GLSL para o backend de CPU. As funções seguem a mesma
+// semântica das built-ins da GLSL para que o código do template.glsl possa
+// ser transcrito quase linha a linha.
+struct vec2 {
+  float x, y;
+  vec2() : x(0), y(0) {}
+  explicit vec2(float s) : x(s), y(s) {}
+  vec2(float x, float y) : x(x), y(y) {}
+};
+
+struct vec3 {
+  float x, y, z;
+  vec3() : x(0), y(0), z(0) {}
+  explicit vec3(float s) : x(s), y(s), z(s) {}
+  vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+  float& operator[](int i) {return (&x)[i];}
+  float operator[](int i) const {return (&x)[i];}
+};
+
+inline vec2 operator+(vec2 a, vec2 b) {return vec2(a.x+b.x, a.y+b.y);}
+inline vec2 operator-(vec2 a, vec2 b) {return vec2(a.x-b.x, a.y-b.y);}
+inline vec2 operator*(vec2 a, vec2 b) {return vec2(a.x*b.x, a.y*b.y);}
+inline vec2 operator*(float s, vec2 a) {return vec2(s*a.x, s*a.y);}
+inline vec2 operator*(vec2 a, float s) {return vec2(s*a.x, s*a.y);}
+inline vec2 operator/(vec2 a, vec2 b) {return vec2(a.x/b.x, a.y/b.y);}
+inline vec2 operator/(vec2 a, float s) {return vec2(a.x/s, a.y/s);}
+
+inline vec3 operator-(vec3 a) {return vec3(-a.x, -a.y, -a.z);}
+inline vec3 operator+(vec3 a, vec3 b) {return vec3(a.x+b.x, a.y+b.y, a.z+b.z);}
+inline vec3 operator-(vec3 a, vec3 b) {return vec3(a.x-b.x, a.y-b.y, a.z-b.z);}
+inline vec3 operator*(vec3 a, vec3 b) {return vec3(a.x*b.x, a.y*b.y, a.z*b.z);}
+inline vec3 operator/(vec3 a, vec3 b) {return vec3(a.x/b.x, a.y/b.y, a.z/b.z);}
+inline vec3 operator+(vec3 a, float s) {return vec3(a.x+s, a.y+s, a.z+s);}
+inline vec3 operator-(vec3 a, float s) {return vec3(a.x-s, a.y-s, a.z-s);}
+inline vec3 operator-(float s, vec3 a) {return vec3(s-a.x, s-a.y, s-a.z);}
+inline vec3 operator*(float s, vec3 a) {return vec3(s*a.x, s*a.y, s*a.z);}
+inline vec3 operator*(vec3 a, float s) {return vec3(s*a.x, s*a.y, s*a.z);}
+inline vec3 operator/(vec3 a, float s) {return vec3(a.x/s, a.y/s, a.z/s);}
+inline vec3& operator+=(vec3& a, vec3 b) {a = a + b; return a;}
+inline vec3& operator-=(vec3& a, vec3 b) {a = a - b; return a;}
+inline vec3& operator*=(vec3& a, vec3 b) {a = a * b; return a;}
+inline vec3& operator*=(vec3& a, float s) {a = a * s; return a;}
+inline vec3& operator/=(vec3& a, float s) {a = a / s; return a;}
+inline bool operator==(vec3 a, vec3 b) {return a.x == b.x && a.y == b.y && a.z == b.z;}
+
+inline float dot(vec2 a, vec2 b) {return a.x*b.x + a.y*b.y;}
+inline float dot(vec3 a, vec3 b) {return a.x*b.x + a.y*b.y + a.z*b.z;}
+inline float length(vec2 a) {return std::sqrt(dot(a, a));}
+inline float length(vec3 a) {return std::sqrt(dot(a, a));}
+inline vec3 normalize(vec3 a) {return a / length(a);}
+inline vec2 normalize(vec2 a) {return a / length(a);}
+inline vec3 cross(vec3 a, vec3 b) {
+  return vec3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+inline float sign(float x) {return (x > 0.0f) ? 1.0f : ((x < 0.0f) ? -1.0f : 0.0f);}
+inline float clamp(float x, float a, float b) {return std::min(std::max(x, a), b);}
+inline float mix(float a, float b, float k) {return a*(1.0f-k) + b*k;}
+inline vec2 abs(vec2 a) {return vec2(std::fabs(a.x), std::fabs(a.y));}
+inline vec3 abs(vec3 a) {return vec3(std::fabs(a.x), std::fabs(a.y), std::fabs(a.z));}
+inline vec2 max(vec2 a, float s) {return vec2(std::max(a.x, s), std::max(a.y, s));}
+inline vec3 max(vec3 a, float s) {return vec3(std::max(a.x, s), std::max(a.y, s), std::max(a.z, s));}
+inline vec3 min(vec3 a, vec3 b) {return vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));}
+inline vec3 max(vec3 a, vec3 b) {return vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));}
+inline vec3 clamp(vec3 a, float lo, float hi) {
+  return vec3(clamp(a.x, lo, hi), clamp(a.y, lo, hi), clamp(a.z, lo, hi));
+}
+inline vec3 mix(vec3 a, vec3 b, float k) {return a*(1.0f-k) + b*k;}
+inline vec3 pow(vec3 a, vec3 e) {
+  return vec3(std::pow(a.x, e.x), std::pow(a.y, e.y), std::pow(a.z, e.z));
+}
+inline float maxComponent(vec3 a) {return std::max(a.x, std::max(a.y, a.z));}
+
+inline vec3 reflect(vec3 i, vec3 n) {return i - 2.0f * dot(n, i) * n;}
+inline vec3 refract(vec3 i, vec3 n, float eta) {
+  float k = 1.0f - eta * eta * (1.0f - dot(n, i) * dot(n, i));
+  if (k < 0.0f)
+    return vec3(0.0f);
+  return eta * i - (eta * dot(n, i) + std::sqrt(k)) * n;
+}
+
+#endif // VECMATH_HPP
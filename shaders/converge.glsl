@@ -0,0 +1,23 @@
+#version 330
+precision highp float;
+
+layout(location = 0) out vec3 outColor;
+layout(location = 1) out vec3 outMoments;
+
+uniform vec2 iResolution;
+uniform sampler2D accumTexture;
+uniform sampler2D momentsTexture;
+uniform float threshold;
+
+// Amostragem adaptativa: os pixels com erro abaixo do limite passam e são
+// marcados no stencil pelo Renderer. O estado deles é copiado para o buffer
+// que os próximos passos escrevem, pois esses passos não os tocam mais.
+void main() {
+  vec2 uv = gl_FragCoord.xy / iResolution.xy;
+  vec3 moments = texture2D(momentsTexture, uv).rgb;
+  if (moments.b >= threshold)
+    discard;
+
+  outColor = texture2D(accumTexture, uv).rgb;
+  outMoments = moments;
+}
@@ -0,0 +1,89 @@
+#version 330
+precision highp float;
+
+// Iluminação filtrada e tolerância de luminância do pixel (alpha).
+out vec4 outColor;
+
+uniform vec2 iResolution;
+uniform sampler2D colorTexture;   // média acumulada ou passo anterior
+uniform sampler2D momentsTexture; // E[L²], amostras e erro
+uniform sampler2D albedoTexture;  // somas do albedo e amostras
+uniform sampler2D normalTexture;  // somas da normal e da profundidade
+uniform int stepWidth;            // 0 prepara a entrada do primeiro passo
+uniform bool remodulate;          // último passo: multiplica pelo albedo
+uniform float sigmaLuminance, sigmaNormal, sigmaDepth, albedoFloor;
+
+// Filtro à-trous guiado por arestas (Dammertz et al., 2010). A conta é a
+// mesma do denoise() em denoiser.cpp, que trata as imagens gravadas em
+// arquivo.
+const float kernel[5] = float[](1.0/16, 1.0/4, 3.0/8, 1.0/4, 1.0/16);
+
+float luminance(vec3 c) {
+  return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+ivec2 clampPixel(ivec2 p) {
+  return clamp(p, ivec2(0), ivec2(iResolution) - 1);
+}
+
+vec3 albedoAt(ivec2 p) {
+  vec4 a = texelFetch(albedoTexture, p, 0);
+  return max((a.a > 0.0) ? a.rgb / a.a : vec3(1.0), vec3(albedoFloor));
+}
+
+vec4 normalAt(ivec2 p) {
+  float count = texelFetch(albedoTexture, p, 0).a;
+  return (count > 0.0) ? texelFetch(normalTexture, p, 0) / count : vec4(0.0);
+}
+
+// Variância da média da luminância de um pixel.
+float variance(ivec2 p) {
+  vec3 moments = texelFetch(momentsTexture, p, 0).rgb;
+  float mean = luminance(texelFetch(colorTexture, p, 0).rgb);
+  if (moments.g < 2.0)
+    return 1e30;
+  float v = max(moments.r - mean*mean, 0.0) / (moments.g - 1.0);
+  return (isnan(v) || isinf(v)) ? 0.0 : v;
+}
+
+void main() {
+  ivec2 p = ivec2(gl_FragCoord.xy);
+  vec3 a = albedoAt(p);
+
+  if (stepWidth == 0) {
+    // Iluminação e tolerância a partir da variância média 3x3.
+    vec3 c = texelFetch(colorTexture, p, 0).rgb;
+    if (any(isnan(c)) || any(isinf(c)))
+      c = vec3(0.0);
+    float sum = 0.0;
+    for (int dy = -1; dy <= 1; ++dy)
+      for (int dx = -1; dx <= 1; ++dx)
+        sum += variance(clampPixel(p + ivec2(dx, dy)));
+    outColor = vec4(c / a, sigmaLuminance * sqrt(sum / 9.0) / luminance(a));
+    return;
+  }
+
+  vec4 center = texelFetch(colorTexture, p, 0);
+  vec4 np = normalAt(p);
+  float lp = luminance(center.rgb);
+  float sigma = center.a / float(stepWidth); // cai à metade a cada passo
+  vec3 sum = vec3(0.0);
+  float weights = 0.0;
+  for (int dy = -2; dy <= 2; ++dy)
+    for (int dx = -2; dx <= 2; ++dx) {
+      ivec2 q = clampPixel(p + stepWidth * ivec2(dx, dy));
+      vec3 c = texelFetch(colorTexture, q, 0).rgb;
+      vec4 nq = normalAt(q);
+      vec3 dn = nq.xyz - np.xyz;
+      float dist = float(stepWidth) * sqrt(float(dx*dx + dy*dy));
+      float e = abs(luminance(c) - lp) / (sigma + 1e-4) +
+                dot(dn, dn) / (sigmaNormal * sigmaNormal) +
+                abs(nq.w - np.w) / (sigmaDepth * np.w * dist + 1e-4);
+      float w = kernel[dx + 2] * kernel[dy + 2] * exp(-e);
+      sum += w * c;
+      weights += w;
+    }
+
+  vec3 col = sum / weights;
+  outColor = vec4(remodulate ? col * a : col, center.a);
+}
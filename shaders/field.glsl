@@ -0,0 +1,38 @@
+// Campo de distância pré-calculado (DistanceField, enviado por
+// Renderer::bakeField). Incluído pelo ShaderGenerator só com --bake; a
+// consulta é a mesma de DistanceField::coarseSample e fineSample.
+uniform sampler3D fieldCoarse;  // map() nos vértices da grade grossa
+uniform isampler3D fieldIndex;  // bloco fino de cada célula, ou -1
+uniform sampler3D fieldBricks;  // atlas dos blocos finos
+uniform vec3 fieldLo;           // canto da grade
+uniform float fieldCell;        // lado das células
+uniform ivec3 fieldCells;       // células por eixo
+uniform ivec3 fieldAtlas;       // blocos por eixo do atlas
+
+#define FIELD_BRICK 8
+#define FIELD_MARGIN 0.9
+
+// Limite inferior de s*map(p) pelo campo, ou o próprio s*map(p) fora da
+// grade e quando o limite fica abaixo de near, perto da superfície. Um
+// passo de ao menos uma célula sai só da grade grossa, sem consultar o
+// índice dos blocos.
+float fieldMap(vec3 p, float s, float near) {
+  vec3 q = (p - fieldLo) / fieldCell;
+  if (any(lessThan(q, vec3(0.0))) || any(greaterThanEqual(q, vec3(fieldCells))))
+    return s*map(p);
+
+  float r = s*texture(fieldCoarse, (q + 0.5) / vec3(fieldCells + 1)).r - FIELD_MARGIN*fieldCell;
+  if (r >= max(near, fieldCell))
+    return r;
+
+  ivec3 c = ivec3(q);
+  int brick = texelFetch(fieldIndex, c, 0).r;
+  if (brick >= 0) {
+    ivec3 b = ivec3(brick % fieldAtlas.x, (brick / fieldAtlas.x) % fieldAtlas.y,
+                    brick / (fieldAtlas.x * fieldAtlas.y));
+    vec3 l = clamp(q - vec3(c), 0.0, 1.0) * float(FIELD_BRICK - 1);
+    float d = texture(fieldBricks, (vec3(b * FIELD_BRICK) + 0.5 + l) / vec3(fieldAtlas * FIELD_BRICK)).r;
+    r = max(r, s*d - FIELD_MARGIN*fieldCell / float(FIELD_BRICK - 1));
+  }
+  return r >= near ? r : s*map(p);
+}
@@ -0,0 +1,110 @@
+// Interseção dos raios com as malhas de triângulos, percorrendo a
+// TriangleBVH enviada pelo Renderer (uploadMeshes). Incluído pelo
+// ShaderGenerator só quando a cena tem malhas; os índices vão como float,
+// exatos até 2^24.
+uniform samplerBuffer meshNodes;     // (lo, filho direito ou 1º triângulo), (hi, triângulos)
+uniform samplerBuffer meshTriangles; // (v0, objeto), aresta 1, aresta 2
+
+#define MESH_STACK 64
+
+ivec4 meshMaterial(int object); // gerada: material, propriedade e objeto
+
+// Distância de entrada na caixa do nó, ou 1e30 se o raio não a cruza antes
+// de tmax.
+float meshBox(vec3 ro, vec3 invRd, int node, float tmax) {
+  vec3 lo = texelFetch(meshNodes, 2*node).xyz, hi = texelFetch(meshNodes, 2*node + 1).xyz;
+  vec3 t0 = (lo - ro) * invRd, t1 = (hi - ro) * invRd;
+  vec3 tn = min(t0, t1), tf = max(t0, t1);
+  float enter = max(max(tn.x, tn.y), max(tn.z, 0.0));
+  float leave = min(min(tf.x, tf.y), min(tf.z, tmax));
+  return enter <= leave ? enter : 1e30;
+}
+
+// Möller-Trumbore: distância até o triângulo i em (0, tmax), ou -1.
+float meshTriangle(vec3 ro, vec3 rd, int i, float tmax) {
+  vec3 v0 = texelFetch(meshTriangles, 3*i).xyz;
+  vec3 e1 = texelFetch(meshTriangles, 3*i + 1).xyz;
+  vec3 e2 = texelFetch(meshTriangles, 3*i + 2).xyz;
+  vec3 pv = cross(rd, e2);
+  float det = dot(e1, pv);
+  if (det == 0.0)
+    return -1.0;
+  float inv = 1.0 / det;
+  vec3 tv = ro - v0;
+  float u = dot(tv, pv) * inv;
+  if (u < 0.0 || u > 1.0)
+    return -1.0;
+  vec3 qv = cross(tv, e1);
+  float v = dot(rd, qv) * inv;
+  if (v < 0.0 || u + v > 1.0)
+    return -1.0;
+  float t = dot(e2, qv) * inv;
+  return (t > 0.0 && t < tmax) ? t : -1.0;
+}
+
+// Triângulo mais próximo antes de tmax (ou, com anyHit, o primeiro
+// encontrado). Visita primeiro o filho mais próximo e empilha o outro com
+// a distância até a sua caixa, descartado se um acerto já for mais perto.
+float meshTraverse(vec3 ro, vec3 rd, float tmax, bool anyHit, out int hit) {
+  vec3 invRd = 1.0 / mix(rd, vec3(1e-20), equal(rd, vec3(0.0)));
+  int stackNode[MESH_STACK];
+  float stackT[MESH_STACK];
+  int top = 0;
+  float t = tmax;
+  hit = -1;
+
+  int node = meshBox(ro, invRd, 0, t) < t ? 0 : -1;
+  while (node >= 0) {
+    vec4 a = texelFetch(meshNodes, 2*node), b = texelFetch(meshNodes, 2*node + 1);
+    int count = int(b.w);
+    if (count > 0) {
+      int first = int(a.w);
+      for (int i = first; i < first + count; ++i) {
+        float ti = meshTriangle(ro, rd, i, t);
+        if (ti > 0.0) {
+          t = ti;
+          hit = i;
+          if (anyHit)
+            return t;
+        }
+      }
+      node = -1;
+    } else {
+      int left = node + 1, right = int(a.w);
+      float dl = meshBox(ro, invRd, left, t), dr = meshBox(ro, invRd, right, t);
+      node = -1;
+      if (min(dl, dr) < t) {
+        node = dl <= dr ? left : right;
+        if (max(dl, dr) < t) {
+          stackNode[top] = dl <= dr ? right : left;
+          stackT[top++] = max(dl, dr);
+        }
+      }
+    }
+    while (node < 0 && top > 0) {
+      --top;
+      if (stackT[top] < t)
+        node = stackNode[top];
+    }
+  }
+  return hit >= 0 ? t : -1.0;
+}
+
+float traceMesh(vec3 ro, vec3 rd, float tmax, out ivec4 mat, out vec3 n) {
+  int hit;
+  float t = meshTraverse(ro, rd, tmax, false, hit);
+  mat = ivec4(0);
+  n = vec3(0.0);
+  if (hit < 0)
+    return -1.0;
+  vec4 v0 = texelFetch(meshTriangles, 3*hit);
+  n = normalize(cross(texelFetch(meshTriangles, 3*hit + 1).xyz,
+                      texelFetch(meshTriangles, 3*hit + 2).xyz));
+  mat = meshMaterial(int(v0.w));
+  return t;
+}
+
+bool occludedMesh(vec3 ro, vec3 rd, float tmax) {
+  int hit;
+  return meshTraverse(ro, rd, tmax, true, hit) >= 0.0;
+}
@@ -2,11 +2,15 @@
 precision highp float;
 
 layout(location = 0) out vec3 outColor;
+layout(location = 1) out vec3 outMoments; // E[L²], amostras e erro do pixel
+layout(location = 2) out vec4 outAlbedo;  // somas do albedo e amostras (denoiser)
+layout(location = 3) out vec4 outNormal;  // somas da normal e da profundidade
 
 uniform float time;
 uniform vec2 iResolution;
 uniform int nLights;
-uniform uint sampleNumber;
+uniform uint samplesPerPass;
+uniform uint adaptiveMin; // amostras antes de estimar o erro do pixel
 
 #define EPS 0.01
 #define EPS2 0.025
@@ -14,93 +18,174 @@ uniform uint sampleNumber;
 #define ITERATIONS 255
 #define BOUNCES 15
 #define MAX_ARRAY 16
+#define MAX_LIGHTS 256
 #define INV_PI 0.31830988618
 #define TWO_PI 6.28318530718
 #define PI 3.14159265359
+#define ERROR_FLOOR 0.05
 
 uniform sampler2D iChannel[MAX_ARRAY];
-float textureScale[MAX_ARRAY];
 
 struct Light {
-  int type; // 0 = point, 1 = sphere
-  vec3 p, col; // position and color emission
+  vec3 p; // position
   float r; // r = radius
+  vec3 col; // color emission
+  int type; // 0 = point, 1 = sphere
 };
-Light lights[MAX_ARRAY];
-float lightCDF[MAX_ARRAY], lightPDF[MAX_ARRAY];
 
 struct Properties {
   vec3 emission;
   float alpha, kr, kt, ior;
 };
-Properties properties[MAX_ARRAY];
-vec3 solidColors[MAX_ARRAY];
-vec3 checkerColorA[MAX_ARRAY];
-vec3 checkerColorB[MAX_ARRAY];
-float checkerSize[MAX_ARRAY];
+
+// Luzes e materiais da cena, enviados uma única vez pela CPU
+// (Renderer::uploadScene). O layout std140 é espelhado em renderer.cpp.
+// lightTable guarda a tabela de alias das luzes (ver lightAliasTable):
+// probabilidade de ficar com a coluna, alias e a pdf da própria luz.
+layout(std140) uniform SceneData {
+  Light lights[MAX_LIGHTS];
+  vec4 lightTable[MAX_LIGHTS];
+  Properties properties[MAX_ARRAY];
+  vec3 solidColors[MAX_ARRAY];
+  vec3 checkerColorA[MAX_ARRAY];
+  vec3 checkerColorB[MAX_ARRAY];
+  float checkerSize[MAX_ARRAY];
+  float textureScale[MAX_ARRAY];
+};
 
 float map(vec3 p);
 void buildCamera(out vec3 ro, out vec3 rd);
-void buildMaterialsAndLights();
-ivec3 selectMaterial(vec3 p);
-
-uint seed;
-
-uint LCG(uint x) {
-  return (1103515245u * x + 12345u) & 0x7fffffffu;
-}
-
-uint wangHash(uint x) {
-    x = (x ^ 61u) ^ (x >> 16);
-    x *= 9u;
-    x = x ^ (x >> 4);
-    x *= 0x27d4eb2du;
-    x = x ^ (x >> 15);
-    return x;
+float mapMat(vec3 p, out ivec4 mat); // map(), material e índice do objeto mais próximo
+vec3 calcNormal(vec3 p, int id);     // normal analítica do objeto id, se houver
+
+// Malhas de triângulos, interceptadas analiticamente (mesh.glsl). Sem
+// malhas na cena, o ShaderGenerator gera versões que nunca acertam.
+float traceMesh(vec3 ro, vec3 rd, float tmax, out ivec4 mat, out vec3 n);
+bool occludedMesh(vec3 ro, vec3 rd, float tmax);
+
+// Passos da marcha: limite inferior de s*map(p) tirado do campo de
+// distância pré-calculado (field.glsl), exato a menos de near da
+// superfície. Sem --bake, o ShaderGenerator gera s*map(p).
+float fieldMap(vec3 p, float s, float near);
+
+// Amostrador: cada chamada de rand() ou rand2() é uma dimensão do caminho.
+// A amostra s de cada dimensão é o ponto s de uma sequência de Sobol (1D ou
+// 2D) com embaralhamento de Owen, cuja semente é um hash (pcg4d, Jarzynski
+// e Olano, 2020) do pixel e da dimensão. O índice também é embaralhado, de
+// modo que dimensões diferentes não se correlacionam (Burley, 2020). O
+// CpuTracer usa exatamente a mesma sequência.
+uniform uint sobolMatrix[64]; // dimensões 0 e 1 de Sobol (ver sobol.hpp)
+uvec2 rngPixel;
+uint rngIndex;  // amostra atual
+uint rngDim;    // próxima dimensão
+
+uvec4 pcg4d(uvec4 v) {
+  v = v * 1664525u + 1013904223u;
+  v.x += v.y*v.w; v.y += v.z*v.x; v.z += v.x*v.y; v.w += v.y*v.z;
+  v ^= v >> 16u;
+  v.x += v.y*v.w; v.y += v.z*v.x; v.z += v.x*v.y; v.w += v.y*v.z;
+  return v;
+}
+
+uint reverseBits(uint x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Embaralhamento de Owen com bits invertidos (Laine e Karras): cada bit é
+// trocado em função dos bits menos significativos.
+uint laineKarras(uint x, uint seed) {
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return x;
+}
+
+uint owenScramble(uint x, uint seed) {
+  return reverseBits(laineKarras(reverseBits(x), seed));
+}
+
+// Uniforme em [0, 1), com os 24 bits que cabem na mantissa.
+float toUnit(uint x) {
+  return float(x >> 8) * (1.0 / 16777216.0);
+}
+
+void seedRand(uvec2 pixel, uint sampleIndex) {
+  rngPixel = pixel;
+  rngIndex = sampleIndex;
+  rngDim = 0u;
+}
+
+// A dimensão 0 de Sobol é a inversão dos bits do índice, então o
+// embaralhamento de Owen dela dispensa a matriz.
+float rand() {
+  uvec4 h = pcg4d(uvec4(rngPixel, rngDim++, 0u));
+  uint i = owenScramble(rngIndex, h.x);
+  return toUnit(reverseBits(laineKarras(i, h.y)));
 }
 
-float rand() {
-  seed = LCG(seed);
-  return clamp(float(seed & 0x3fffffffu) / float(0x3fffffffu), 0.0, 1.0);
+vec2 rand2() {
+  uvec4 h = pcg4d(uvec4(rngPixel, rngDim++, 0u));
+  uint i = owenScramble(rngIndex, h.x);
+  uint y = 0u;
+  int bit = 32;
+  for (uint j = i; j != 0u; j >>= 1, ++bit)
+    if ((j & 1u) != 0u)
+      y ^= sobolMatrix[bit];
+  return vec2(toUnit(reverseBits(laineKarras(i, h.y))),
+              toUnit(owenScramble(y, h.z)));
 }
 
 
-// Calcula a normal com base no gradiente da função de distância.
+// Calcula a normal com base no gradiente da função de distância, amostrado
+// nos vértices de um tetraedro (4 avaliações em vez de 6).
 vec3 calcNormal(vec3 p) {
   float f = sign(map(p));
-  vec2 q = vec2(0.0, EPS);
-  return normalize(f*vec3(map(p + q.yxx) - map(p - q.yxx),
-                          map(p + q.xyx) - map(p - q.xyx),
-                          map(p + q.xxy) - map(p - q.xxy)));
+  vec2 k = vec2(1.0, -1.0) * 0.5773 * EPS;
+  return normalize(f*(k.xyy*map(p + k.xyy) + k.yyx*map(p + k.yyx) +
+                      k.yxy*map(p + k.yxy) + k.xxx*map(p + k.xxx)));
+}
+
+// Lado da superfície em que o ponto está (o interior tem normal invertida).
+float side(float d) {
+  return d < 0.0 ? -1.0 : 1.0;
 }
 
 float shadowcast(vec3 ro, vec3 rd, float tmax) {
+  if (occludedMesh(ro, rd, tmax))
+    return 0.0;
   float t = 0.0, d = 0.0;
   float fsign = sign(map(ro));
   for (float t = 0; t < tmax; ) {
-    d = fsign * map(ro + t * rd);
+    d = fieldMap(ro + t * rd, fsign, EPS);
     if (d < EPS)
-      return 0;
+      return 0.0;
     t += d;
   }
-  return 1;
+  return 1.0;
 }
 
 float shadowcastArea(vec3 ro, vec3 rd, float tmax, int id) {
-  float t = 0.0, d = 0.0;
+  float d = 0.0;
   float fsign = sign(map(ro));
+  ivec4 mat = ivec4(0);
   for (float t = 0; t < tmax; ) {
-    d = fsign * map(ro + t * rd);
+    d = fsign * mapMat(ro + t * rd, mat);
     if (d < EPS)
       break;
     t += d;
   }
-
-  ivec3 mat = selectMaterial(ro + t*rd);
   return (mat.z == id) ? 1.0 : 0.0;
 }
 
-float raycast(vec3 ro, vec3 rd) {
+// Distância até a superfície das SDFs, ou -1 se não houver uma antes de
+// tmax (FAR ou o acerto em uma malha).
+float raycast(vec3 ro, vec3 rd, float tmax) {
   float pixelRadius = 1.0 / iResolution.y;
   
   float functionSign = sign(map(ro));
@@ -109,7 +194,9 @@ float raycast(vec3 ro, vec3 rd) {
   float candidate_error = 10.0*FAR, candidate_t = 0.0, t = 0.0;
 
   for (int i = 0; i < ITERATIONS; ++i) {
-    float signedRadius = functionSign * map(ro + t*rd);
+    // Abaixo de t*pixelRadius a distância é sempre exata: um limite
+    // inferior nunca é aceito como acerto.
+    float signedRadius = fieldMap(ro + t*rd, functionSign, max(EPS, t*pixelRadius));
     float radius = abs(signedRadius);
 
     bool sorFail = omega > 1 && (radius + previousRadius) < stepLength;
@@ -128,11 +215,11 @@ float raycast(vec3 ro, vec3 rd) {
       candidate_error = error;
     }
 
-    if (!sorFail && error < pixelRadius || t > FAR)
+    if (!sorFail && error < pixelRadius || t > tmax)
       break;
     t += 0.8*stepLength;
   }
-  if (t > FAR || candidate_error > pixelRadius)
+  if (t > tmax || candidate_error > pixelRadius)
     return -1.0;
   return t;
 }
@@ -143,11 +230,22 @@ vec3 checkerTexture(vec3 p, int id) {
   return mix(checkerColorA[id], checkerColorB[id], k);
 }
 
+// A GLSL 3.30 só aceita índices constantes em arrays de samplers.
+#define CHANNEL(i) case i: return texture2D(iChannel[i], uv).rgb;
+vec3 channel(int id, vec2 uv) {
+  switch (id) {
+  CHANNEL(2) CHANNEL(3) CHANNEL(4) CHANNEL(5) CHANNEL(6) CHANNEL(7)
+  CHANNEL(8) CHANNEL(9) CHANNEL(10) CHANNEL(11) CHANNEL(12) CHANNEL(13)
+  CHANNEL(14) CHANNEL(15)
+  }
+  return vec3(0.0);
+}
+
 vec3 cubeMap(vec3 p, vec3 n, int id) {
   p /= textureScale[id];
-  vec3 a = pow(texture2D(iChannel[id], p.yz).rgb,vec3(2.2));
-  vec3 b = pow(texture2D(iChannel[id], p.xz).rgb,vec3(2.2));
-  vec3 c = pow(texture2D(iChannel[id], p.xy).rgb,vec3(2.2));
+  vec3 a = pow(channel(id, p.yz),vec3(2.2));
+  vec3 b = pow(channel(id, p.xz),vec3(2.2));
+  vec3 c = pow(channel(id, p.xy),vec3(2.2));
   n = abs(n);
   return (a*n.x + b*n.y + c*n.z)/(n.x+n.y+n.z);   
 }
@@ -176,9 +274,12 @@ vec3 fresnel(vec3 r0, float cosTheta) { // versão para blinn-phong
   return r0 + (1.0 - r0) * pow(1.0 - max(0, cosTheta), 5.0);
 }
 
-vec3 optimizeHit(vec3 p, vec3 rd) {
-  for (int i = 0; i < 10; ++i)
+// Aproxima o ponto da superfície. O último passo também identifica o
+// material do objeto atingido, sem uma nova avaliação da cena.
+vec3 optimizeHit(vec3 p, vec3 rd, out ivec4 mat) {
+  for (int i = 0; i < 9; ++i)
     p += rd * (abs(map(p)) - 0.01/iResolution.y*length(p));
+  p += rd * (abs(mapMat(p, mat)) - 0.01/iResolution.y*length(p));
   return p;
 }
 
@@ -192,8 +293,9 @@ vec3 toWorldSpace(vec3 n, vec3 w) {
 vec3 cosineWeightedSample() {
   // Malley's method.
   vec3 w;
-  float r = sqrt(max(0, rand()));
-  float theta = TWO_PI*rand();
+  vec2 u = rand2();
+  float r = sqrt(u.x);
+  float theta = TWO_PI*u.y;
   w.x = r * cos(theta);
   w.z = r * sin(theta);
   w.y = sqrt(max(0.0, 1.0 - w.x*w.x - w.z*w.z));
@@ -212,43 +314,20 @@ float blinnPDF(float alpha, float cosH, float cosWoH) {
 
 vec3 blinnSample(float alpha) {
   vec3 h;
-  float phi = TWO_PI*rand();
-  h.y = pow(rand(), 1.0 / (alpha + 1.0));
+  vec2 u = rand2();
+  float phi = TWO_PI*u.x;
+  h.y = pow(u.y, 1.0 / (alpha + 1.0));
   h.x = h.z = sqrt(max(0, 1.0 - h.y*h.y));
   h.x *= cos(phi); h.z *= sin(phi);
   return h;
 }
 
-void buildLightDistribution() {
-  float sum = 0;
-  for (int i = 0; i < MAX_ARRAY; ++i) {
-    if (i >= nLights) break;
-    vec3 c = lights[i].col;
-    float emit = max(c.r, max(c.g, c.b));
-    switch(lights[i].type) {
-    case 0: // point light.
-      lightPDF[i] = 4.0 * PI * emit;break;
-    case 1: // sphere light.
-      lightPDF[i] = PI * emit * 4 * PI * pow(lights[i].r, 2.0); break;
-    }
-    sum += lightPDF[i];
-  }
-
-  for (int i = 0; i < MAX_ARRAY; ++i) {
-    if (i >= nLights) break;
-    lightPDF[i] /= sum;
-  }
-}
-
+// Um único número escolhe a coluna e, pela fração restante, entre ela e
+// o seu alias.
 int sampleLightIndex() {
-  float sum = 0;
-  float k = rand();
-  for (int i = 0; i < MAX_ARRAY; ++i) {
-    if (i >= nLights) return i - 1;
-    sum += lightPDF[i];
-    if (k < sum) return i;
-  }
-  return 0;
+  float k = rand() * float(nLights);
+  int i = min(int(k), nLights - 1);
+  return k - float(i) < lightTable[i].x ? i : int(lightTable[i].y);
 }
 
 /*vec3 sampleDiskLight(vec3 p, vec3 n, float r) {
@@ -268,10 +347,10 @@ int sampleLightIndex() {
   }*/
 
 vec3 sampleCone(float cosThetaMax) {
-  float u1 = rand();
-  float cosTheta = (1 - u1) + u1 * cosThetaMax;
+  vec2 u = rand2();
+  float cosTheta = (1 - u.x) + u.x * cosThetaMax;
   float sinTheta = sqrt(max(0, 1 - cosTheta*cosTheta));
-  float phi = TWO_PI * rand();
+  float phi = TWO_PI * u.y;
   return vec3(cos(phi) * sinTheta, cosTheta, sin(phi) * sinTheta);
 }
 
@@ -303,8 +382,10 @@ vec3 sampleSphere(vec3 p, vec3 c, float radius, inout float pdf) {
   return p + t * s;
 }
 
-vec3 directLight(vec3 ro, vec3 rd, float t, vec3 n, vec3 p, vec3 tex, Properties pr) {
-  if (map(p) < 0 || pr.kr > 0 || pr.kt > 0)
+// inside indica um ponto no interior de um objeto; offset é o afastamento
+// da superfície na origem do raio de sombra.
+vec3 directLight(vec3 rd, vec3 n, vec3 p, bool inside, float offset, vec3 tex, Properties pr) {
+  if (inside || pr.kr > 0 || pr.kt > 0)
     return vec3(0.0);
 
   float pdf = 0;
@@ -325,11 +406,11 @@ vec3 directLight(vec3 ro, vec3 rd, float t, vec3 n, vec3 p, vec3 tex, Properties
   lamb = abs(lamb);
 
   if (lights[i].type == 1) {
-    vec3 ln = calcNormal(lightPos);
+    vec3 ln = normalize(lightPos - lights[i].p);
     if (dot(ln, -l) <= 0) return vec3(0.0);
   }
   
-  float shadow = shadowcast(p + max(EPS2, 2.0*abs(map(p)))*n, l, d);
+  float shadow = shadowcast(p + offset*n, l, d);
   vec3 h = normalize(l - rd);
   vec3 fre = fresnel(tex, dot(h, -rd));
   float prob = max(fre.r, max(fre.g, fre.b));
@@ -344,7 +425,7 @@ vec3 directLight(vec3 ro, vec3 rd, float t, vec3 n, vec3 p, vec3 tex, Properties
     col += tex*INV_PI;
   }
   col *= shadow * lamb * lights[i].col;
-  col /= d * d * lightPDF[i] * pdf;
+  col /= d * d * lightTable[i].z * pdf;
   return col + pr.emission;
 }
 
@@ -352,20 +433,37 @@ vec3 getBgColor(vec3 rd) {
   return 0.5*vec3(0.7, 0.8, 1.0)*(1.0-0.5*rd.y);
 }
 
-vec3 raytrace(vec3 ro, vec3 rd) {
+// Além da radiância, devolve os dados auxiliares do denoiser: albedo,
+// normal e profundidade do primeiro ponto não especular do caminho. Os
+// espelhos e vidros são atravessados, acumulando sua cor no albedo; um
+// caminho que escapa fica com normal nula e profundidade FAR.
+vec3 raytrace(vec3 ro, vec3 rd, out vec3 albedo, out vec4 normal) {
   vec3 L = vec3(0);
   vec3 pathThroughput = vec3(1);
 
   //float pathDistance = 0.0;
   bool specularBounce = false;
+  bool auxDone = false;
+  albedo = vec3(1);
+  normal = vec4(0, 0, 0, FAR);
+  float depth = 0.0;
   
   for (int i = 0; i < BOUNCES; ++i) {
-    float t = raycast(ro, rd);
+    // A marcha sobre as SDFs só vai até o acerto na malha, se houver.
+    ivec4 mat;
+    vec3 n;
+    float t = traceMesh(ro, rd, FAR, mat, n);
+    bool meshHit = t >= 0;
+    float tSDF = raycast(ro, rd, meshHit ? t : FAR);
+    if (tSDF >= 0) {
+      t = tSDF;
+      meshHit = false;
+    }
     if (t < 0) {
       // calcula iluminação direta para luzes especulares
       // somente se o último raio a bater for especular.
       if (specularBounce)
-        for (int i = 0; i < MAX_ARRAY; ++i) {
+        for (int i = 0; i < MAX_LIGHTS; ++i) {
           if (i >= nLights) break;
           if (lights[i].type == 0) {
             float k = dot(lights[i].p - ro, lights[i].p - ro);
@@ -376,24 +474,45 @@ vec3 raytrace(vec3 ro, vec3 rd) {
       break;
     }
    
-    // Informações do ponto de colisão.
-    vec3 p = optimizeHit(ro + t*rd, rd);
-    vec3 n = calcNormal(p);
+    // Informações do ponto de colisão. Na malha, o interior é o lado para
+    // onde a normal geométrica aponta (faces no sentido anti-horário).
+    vec3 p;
+    bool inside;
+    float offset;
+    if (meshHit) {
+      p = ro + t*rd;
+      inside = dot(n, rd) > 0;
+      n = inside ? -n : n;
+      offset = EPS2;
+    } else {
+      p = optimizeHit(ro + t*rd, rd, mat);
+      n = calcNormal(p, mat.w);
+      float d = map(p);
+      inside = d < 0;
+      offset = max(EPS2, 2.0*abs(d));
+    }
     //pathDistance += length(p - ro);
       
     // Informações do material.
     vec3 tex; Properties pr;
-    ivec3 mat = selectMaterial(p);
-    getProperties(p, n, mat, tex, pr);
+    getProperties(p, n, mat.xyz, tex, pr);
+
+    if (!auxDone) {
+      albedo *= tex;
+      depth += t;
+      auxDone = pr.kt <= 0 && pr.kr <= 0;
+      if (auxDone)
+        normal = vec4(n, depth);
+    }
 
     if (i == 0 || specularBounce)
       L+= pathThroughput * pr.emission;
-    L += pathThroughput * directLight(ro, rd, t, n, p, tex, pr);
+    L += pathThroughput * directLight(rd, n, p, inside, offset, tex, pr);
    
     float flip = 1;
     if (pr.kt > 0) {
       // Transmissão (BSTF) com reflexões internas e fresnel
-      float ior = (map(p) < 0) ? 1.0/pr.ior : pr.ior;
+      float ior = inside ? 1.0/pr.ior : pr.ior;
       float fre = fresnel(ior, dot(-rd, n));
 
       if (rand() < fre) {
@@ -450,32 +569,78 @@ vec3 raytrace(vec3 ro, vec3 rd) {
     }
 
     pathThroughput = clamp(pathThroughput, 0.0, 1.0);
-    ro = p + flip*max(EPS2, 2.0*abs(map(p)))*n;
+    ro = p + flip*offset*n;
   }
   
   return L;
 }
 
+float luminance(vec3 c) {
+  return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Erro relativo da média: desvio padrão estimado da média da luminância
+// sobre a própria luminância, com um piso para os pixels escuros. O
+// CpuTracer usa a mesma fórmula (pixelError em cpu_renderer.cpp).
+float pixelError(float mean, float m2, float n) {
+  if (n < float(max(adaptiveMin, 2u)))
+    return 1e30;
+  return sqrt(max(m2 - mean*mean, 0.0) / (n - 1.0)) / (mean + ERROR_FLOOR);
+}
+
+#ifdef BAKE_FIELD
+// Pré-cálculo do campo de distância (Renderer::bakeField): cada fragmento
+// avalia o map() em um ponto da lista, em linhas de BAKE_WIDTH.
+#define BAKE_WIDTH 1024
+uniform samplerBuffer bakePoints;
+
+void main() {
+  int i = int(gl_FragCoord.y) * BAKE_WIDTH + int(gl_FragCoord.x);
+  outColor = vec3(map(texelFetch(bakePoints, i).xyz));
+}
+#else
 void main() {
   vec3 ro, rd;
   vec2 uv = gl_FragCoord.xy/iResolution.xy;
-
-  float lastRand = texture2D(iChannel[1], uv).r;
-  
-  seed = uint(gl_FragCoord.y * iResolution.y + gl_FragCoord.x);
-  seed = wangHash(seed + wangHash(sampleNumber));
+  vec3 mean = texture2D(iChannel[0], uv).rgb;
+  vec3 moments = texture2D(iChannel[1], uv).rgb;
+  float n = moments.g;
   
-  buildCamera(ro, rd);
-  buildMaterialsAndLights();
-  buildLightDistribution();
-  
-  vec3 col = raytrace(ro, rd);
+  // Vários caminhos por invocação amortizam o custo fixo de cada passo. O
+  // índice da amostra é o contador do próprio pixel.
+  vec3 col = vec3(0.0), albedo = vec3(0.0);
+  vec4 normal = vec4(0.0);
+  float m2 = 0.0;
+  for (uint k = 0u; k < samplesPerPass; ++k) {
+    seedRand(uvec2(gl_FragCoord.xy), uint(n) + k);
+    buildCamera(ro, rd);
+    vec3 a; vec4 g;
+    vec3 c = raytrace(ro, rd, a, g);
+    col += c;
+    m2 += luminance(c) * luminance(c);
+    albedo += a;
+    normal += g;
+  }
   
   // Moving average.
-  col += sampleNumber * texture2D(iChannel[0], uv).rgb;
-  col /= sampleNumber + 1u;
+  float total = n + float(samplesPerPass);
+  col += n * mean;
+  col /= total;
+  m2 = (m2 + n * moments.r) / total;
 
   outColor = col;
+  outMoments = vec3(m2, total, pixelError(luminance(col), m2, total));
+
+  // Os buffers auxiliares só existem com o denoiser e são somados pelo
+  // blending, sem ping-pong.
+  outAlbedo = vec4(albedo, float(samplesPerPass));
+  outNormal = normal;
+}
+#endif
+
+// Distância até a caixa [lo, hi] (zero no interior), usada pela BVH do map().
+float bound(vec3 p, vec3 lo, vec3 hi) {
+  return length(max(max(lo - p, p - hi), 0.0));
 }
 
 float sphere(vec3 p, vec4 sph) {
@@ -516,3 +681,36 @@ float disk(vec3 p, vec3 x, vec3 n, float r) {
   float l = length(p - dot(p, n)*n);
   return max(l - r,  abs(plane(p, vec4(n, 0))));
 }
+
+// Gradientes das funções de distância acima, usados pelo calcNormal(p, id)
+// gerado para evitar as diferenças finitas.
+vec3 sphereNormal(vec3 p, vec4 sph) {
+  return normalize(p - sph.xyz);
+}
+
+vec3 boxNormal(vec3 p, vec3 x, vec3 b) {
+  p -= x;
+  vec3 d = abs(p) - b;
+  if (max(d.x, max(d.y, d.z)) > 0.0)
+    return normalize(max(d, 0.0) * sign(p));
+  if (d.x > d.y && d.x > d.z)
+    return vec3(sign(p.x), 0.0, 0.0);
+  if (d.y > d.z)
+    return vec3(0.0, sign(p.y), 0.0);
+  return vec3(0.0, 0.0, sign(p.z));
+}
+
+vec3 torusNormal(vec3 p, vec3 x, vec2 t) {
+  p -= x;
+  return normalize(p - t.x * normalize(vec3(p.x, 0.0, p.z)));
+}
+
+vec3 cylinderNormal(vec3 p, vec3 x, vec2 h) {
+  p -= x;
+  float r = length(p.xz);
+  vec2 d = vec2(r, abs(p.y)) - h;
+  vec2 g = (max(d.x, d.y) > 0.0) ? normalize(max(d, 0.0)) :
+           ((d.x > d.y) ? vec2(1.0, 0.0) : vec2(0.0, 1.0));
+  vec2 radial = (r > 0.0) ? p.xz / r : vec2(1.0, 0.0);
+  return normalize(vec3(g.x * radial.x, g.y * sign(p.y), g.x * radial.y));
+}
@@ -0,0 +1,217 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+
+bool primitiveBounds(const ScenePrimitive& object, AABB& box) {
+  const std::vector<float>& k = object.params;
+  vec3 x = k.size() >= 3 ? vec3(k[0], k[1], k[2]) : vec3(0);
+  vec3 e;
+  switch (object.type) {
+    case PRIMITIVE_SPHERE:
+      e = vec3(std::fabs(k[3]));
+      break;
+    case PRIMITIVE_BOX:
+      e = abs(vec3(k[3], k[4], k[5]));
+      break;
+    case PRIMITIVE_TORUS: {
+      float r = std::fabs(k[3]) + std::fabs(k[4]);
+      e = vec3(r, std::fabs(k[4]), r);
+      break;
+    }
+    case PRIMITIVE_CYLINDER:
+      e = vec3(std::fabs(k[3]), std::fabs(k[4]), std::fabs(k[3]));
+      break;
+    case PRIMITIVE_DISK: {
+      // Extensão de um círculo de raio r com normal n em cada eixo.
+      vec3 n(k[3], k[4], k[5]);
+      float r = std::fabs(k[6]);
+      e = vec3(r * std::sqrt(std::max(0.0f, 1.0f - n.x*n.x)),
+               r * std::sqrt(std::max(0.0f, 1.0f - n.y*n.y)),
+               r * std::sqrt(std::max(0.0f, 1.0f - n.z*n.z)));
+      break;
+    }
+    default:
+      return false;
+  }
+  box = AABB(x - e, x + e);
+  return true;
+}
+
+BVH::BVH(const std::vector<ScenePrimitive>& objects, int leafSize)
+  : m_bounds(objects.size()), m_leafSize(std::max(1, leafSize)) {
+  for (size_t i = 0; i < objects.size(); ++i) {
+    if (objects[i].type == PRIMITIVE_MESH) // fora do map() (ver TriangleBVH)
+      continue;
+    if (primitiveBounds(objects[i], m_bounds[i]))
+      m_primitives.push_back(i);
+    else
+      m_unbounded.push_back(i);
+  }
+  if (!m_primitives.empty())
+    build(0, m_primitives.size());
+}
+
+// Divide os objetos pela mediana dos centros no maior eixo.
+int BVH::build(int first, int last) {
+  int index = m_nodes.size();
+  m_nodes.push_back(BVHNode());
+
+  AABB box, centers;
+  for (int i = first; i < last; ++i) {
+    const AABB& b = m_bounds[m_primitives[i]];
+    box.extend(b);
+    centers.extend(AABB(b.center(), b.center()));
+  }
+
+  BVHNode node;
+  node.box = box;
+  node.left = node.right = -1;
+  node.first = first;
+  node.count = last - first;
+  if (last - first > m_leafSize) {
+    vec3 size = centers.hi - centers.lo;
+    int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+    int mid = (first + last) / 2;
+    std::nth_element(m_primitives.begin() + first, m_primitives.begin() + mid,
+                     m_primitives.begin() + last, [&](int a, int b) {
+                       return m_bounds[a].center()[axis] < m_bounds[b].center()[axis];
+                     });
+    node.left = build(first, mid);
+    node.right = build(mid, last);
+    node.count = 0;
+  }
+  m_nodes[index] = node;
+  return index;
+}
+
+// ====================== TRIANGLE BVH ======================
+// Intervalos por eixo na avaliação da SAH.
+#define SAH_BINS 16
+
+// Abaixo desta profundidade os nós são divididos pela mediana, o que limita
+// a altura da árvore (e a pilha do percurso no shader).
+#define SAH_MAX_DEPTH 32
+
+static float area(const AABB& b) {
+  vec3 e = max(b.hi - b.lo, 0.0f);
+  return 2.0f * (e.x*e.y + e.y*e.z + e.z*e.x);
+}
+
+TriangleBVH::TriangleBVH(const std::vector<SceneMesh>& meshes, int leafSize)
+  : m_leafSize(std::max(1, leafSize)), m_depth(0) {
+  std::vector<MeshTriangle> triangles;
+  for (size_t m = 0; m < meshes.size(); ++m) {
+    const SceneMesh& mesh = meshes[m];
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+      vec3 a = mesh.vertices[mesh.indices[i]], b = mesh.vertices[mesh.indices[i+1]];
+      vec3 c = mesh.vertices[mesh.indices[i+2]];
+      MeshTriangle t = {a, b - a, c - a, mesh.object};
+      triangles.push_back(t);
+      AABB box(min(a, min(b, c)), max(a, max(b, c)));
+      m_bounds.push_back(box);
+      m_centers.push_back(box.center());
+    }
+  }
+
+  m_order.resize(triangles.size());
+  for (size_t i = 0; i < m_order.size(); ++i)
+    m_order[i] = i;
+  if (!m_order.empty())
+    build(0, m_order.size(), 1);
+
+  m_triangles.resize(triangles.size());
+  for (size_t i = 0; i < m_order.size(); ++i)
+    m_triangles[i] = triangles[m_order[i]];
+  m_bounds.clear(); m_centers.clear(); m_order.clear();
+}
+
+// Escolhe, entre os limites dos intervalos dos três eixos, o plano de
+// menor custo SAH; se nenhum for melhor que uma folha, para.
+int TriangleBVH::build(int first, int last, int depth) {
+  int index = m_nodes.size();
+  m_nodes.push_back(BVHNode());
+  m_depth = std::max(m_depth, depth);
+
+  AABB box, centers;
+  for (int i = first; i < last; ++i) {
+    box.extend(m_bounds[m_order[i]]);
+    const vec3& c = m_centers[m_order[i]];
+    centers.extend(AABB(c, c));
+  }
+
+  BVHNode node;
+  node.box = box;
+  node.left = node.right = -1;
+  node.first = first;
+  node.count = last - first;
+
+  int count = last - first, mid = -1;
+  vec3 size = centers.hi - centers.lo;
+  if (count > 1 && depth < SAH_MAX_DEPTH && maxComponent(size) > 0.0f) {
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = count * area(box); // custo da folha (sem normalizar)
+    for (int axis = 0; axis < 3; ++axis) {
+      if (size[axis] <= 0.0f)
+        continue;
+      AABB bins[SAH_BINS];
+      int counts[SAH_BINS] = {0};
+      float scale = SAH_BINS / size[axis];
+      for (int i = first; i < last; ++i) {
+        int b = std::min(SAH_BINS - 1, int((m_centers[m_order[i]][axis] - centers.lo[axis]) * scale));
+        bins[b].extend(m_bounds[m_order[i]]);
+        counts[b]++;
+      }
+      // Áreas acumuladas da direita para a esquerda, depois a varredura.
+      float rightArea[SAH_BINS];
+      int rightCount[SAH_BINS];
+      AABB acc;
+      int n = 0;
+      for (int b = SAH_BINS - 1; b > 0; --b) {
+        acc.extend(bins[b]);
+        n += counts[b];
+        rightArea[b] = area(acc);
+        rightCount[b] = n;
+      }
+      acc = AABB();
+      n = 0;
+      for (int b = 1; b < SAH_BINS; ++b) {
+        acc.extend(bins[b-1]);
+        n += counts[b-1];
+        if (n == 0 || rightCount[b] == 0)
+          continue;
+        float cost = area(box) + n * area(acc) + rightCount[b] * rightArea[b];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = b;
+        }
+      }
+    }
+
+    if (bestAxis >= 0) {
+      float lo = centers.lo[bestAxis], scale = SAH_BINS / size[bestAxis];
+      mid = std::partition(m_order.begin() + first, m_order.begin() + last, [&](int t) {
+        return std::min(SAH_BINS - 1, int((m_centers[t][bestAxis] - lo) * scale)) < bestBin;
+      }) - m_order.begin();
+      if (mid <= first || mid >= last)
+        mid = -1;
+    }
+  }
+
+  // Folhas grandes demais (SAH sem ganho ou profundidade máxima) são
+  // divididas pela mediana do maior eixo.
+  if (mid < 0 && count > m_leafSize) {
+    int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+    mid = (first + last) / 2;
+    std::nth_element(m_order.begin() + first, m_order.begin() + mid, m_order.begin() + last,
+                     [&](int a, int b) {return m_centers[a][axis] < m_centers[b][axis];});
+  }
+
+  if (mid >= 0) {
+    node.left = build(first, mid, depth + 1);
+    node.right = build(mid, last, depth + 1);
+    node.count = 0;
+  }
+  m_nodes[index] = node;
+  return index;
+}
@@ -0,0 +1,81 @@
+#include "checkpoint.hpp"
+#include "hash.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <unistd.h>
+
+static const char MAGIC[8] = {'F', 'P', 'T', 'C', 'K', 'P', 'T', '2'};
+
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t backend, width, height, samples;
+  uint64_t sceneHash;
+};
+
+// Grava em um arquivo temporário e renomeia: uma interrupção durante a
+// escrita nunca destrói o checkpoint anterior.
+void Checkpoint::save(const std::string& path) const {
+  CheckpointHeader header;
+  std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+  header.backend = backend;
+  header.width = width;
+  header.height = height;
+  header.samples = samples;
+  header.sceneHash = sceneHash;
+
+  std::stringstream tmp;
+  tmp << path << "." << getpid() << ".tmp";
+  {
+    std::ofstream output(tmp.str().c_str(), std::ios::binary);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(&data[0]), data.size() * sizeof(float));
+    output.write(reinterpret_cast<const char*>(&moments[0]), moments.size() * sizeof(float));
+    output.flush();
+    if (!output) {
+      output.close();
+      remove(tmp.str().c_str());
+      throw std::runtime_error("Erro durante a escrita do checkpoint " + path);
+    }
+  }
+  if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+    remove(tmp.str().c_str());
+    throw std::runtime_error("Erro durante a escrita do checkpoint " + path);
+  }
+}
+
+void Checkpoint::load(const std::string& path) {
+  std::ifstream input(path.c_str(), std::ios::binary);
+  if (!input.is_open())
+    throw std::runtime_error("Arquivo não encontrado: " + path);
+
+  CheckpointHeader header;
+  input.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!input || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), header.magic))
+    throw std::runtime_error(path + " não é um checkpoint válido");
+
+  backend = header.backend;
+  width = header.width;
+  height = header.height;
+  samples = header.samples;
+  sceneHash = header.sceneHash;
+  data.resize(3 * size_t(width) * height);
+  moments.resize(data.size());
+  input.read(reinterpret_cast<char*>(&data[0]), data.size() * sizeof(float));
+  input.read(reinterpret_cast<char*>(&moments[0]), moments.size() * sizeof(float));
+  if (!input)
+    throw std::runtime_error("Erro durante a leitura do checkpoint " + path);
+}
+
+unsigned long long sceneHash(const std::string& sceneFile) {
+  std::ifstream input(sceneFile.c_str(), std::ios::binary);
+  if (!input.is_open())
+    throw std::runtime_error("Arquivo não encontrado: " + sceneFile);
+  return fnv1a(std::string(std::istreambuf_iterator<char>(input),
+                           std::istreambuf_iterator<char>()));
+}
@@ -0,0 +1,1067 @@
+#include "cpu_renderer.hpp"
+
+#include <cstdint>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+
+// Constantes do template.glsl
+#define EPS 0.01f
+#define EPS2 0.025f
+#define FAR 150.0f
+#define ITERATIONS 255
+#define BOUNCES 15
+#define INV_PI 0.31830988618f
+#define TWO_PI 6.28318530718f
+#define PI 3.14159265359f
+
+#define TILE_SIZE 16
+#define ERROR_FLOOR 0.05f
+
+// ====================== FUNÇÕES DE DISTÂNCIA ======================
+static float sphere(vec3 p, vec3 c, float r) {
+  return length(p - c) - r;
+}
+
+static float plane(vec3 p, vec3 n, float w) {
+  return (dot(p, n) + w) / length(n);
+}
+
+static float box(vec3 p, vec3 x, vec3 b) {
+  p -= x;
+  vec3 d = abs(p) - b;
+  return std::min(std::max(d.x, std::max(d.y, d.z)), 0.0f) + length(max(d, 0.0f));
+}
+
+static float torus(vec3 p, vec3 x, vec2 t) {
+  p -= x;
+  vec2 q = vec2(length(vec2(p.x, p.z)) - t.x, p.y);
+  return length(q) - t.y;
+}
+
+static float cone(vec3 p, vec3 x, vec2 c) {
+  p -= x;
+  float q = length(vec2(p.x, p.z));
+  return dot(normalize(c), vec2(q, p.y));
+}
+
+static float cylinder(vec3 p, vec3 x, vec2 h) {
+  p -= x;
+  vec2 d = abs(vec2(length(vec2(p.x, p.z)), p.y)) - h;
+  return std::min(std::max(d.x, d.y), 0.0f) + length(max(d, 0.0f));
+}
+
+static float disk(vec3 p, vec3 x, vec3 n, float r) {
+  p -= x;
+  float l = length(p - dot(p, n)*n);
+  return std::max(l - r, std::fabs(plane(p, n, 0.0f)));
+}
+
+// Gradientes das funções de distância (sphereNormal etc. no template.glsl).
+static float side(float d) {
+  return d < 0.0f ? -1.0f : 1.0f;
+}
+
+static vec3 boxNormal(vec3 p, vec3 x, vec3 b) {
+  p -= x;
+  vec3 d = abs(p) - b;
+  if (maxComponent(d) > 0.0f)
+    return normalize(max(d, 0.0f) * vec3(sign(p.x), sign(p.y), sign(p.z)));
+  if (d.x > d.y && d.x > d.z)
+    return vec3(sign(p.x), 0.0f, 0.0f);
+  if (d.y > d.z)
+    return vec3(0.0f, sign(p.y), 0.0f);
+  return vec3(0.0f, 0.0f, sign(p.z));
+}
+
+static vec3 torusNormal(vec3 p, vec3 x, vec2 t) {
+  p -= x;
+  return normalize(p - t.x * normalize(vec3(p.x, 0.0f, p.z)));
+}
+
+static vec3 cylinderNormal(vec3 p, vec3 x, vec2 h) {
+  p -= x;
+  float r = length(vec2(p.x, p.z));
+  vec2 d = vec2(r, std::fabs(p.y)) - h;
+  vec2 g = (std::max(d.x, d.y) > 0.0f) ? normalize(max(d, 0.0f)) :
+           ((d.x > d.y) ? vec2(1.0f, 0.0f) : vec2(0.0f, 1.0f));
+  vec2 radial = (r > 0.0f) ? vec2(p.x / r, p.z / r) : vec2(1.0f, 0.0f);
+  return normalize(vec3(g.x * radial.x, g.y * sign(p.y), g.x * radial.y));
+}
+
+// Transcrições dos objetos externos distribuídos em shaders/.
+static float smin(float a, float b, float k) {
+  float h = clamp(0.5f + 0.5f*(b-a)/k, 0.0f, 1.0f);
+  return mix(b, a, h) - k*h*(1.0f-h);
+}
+
+static float line(vec3 p, vec3 a, vec3 b, float r) {
+  vec3 pa = p - a, ba = b - a;
+  float h = clamp(dot(pa, ba)/dot(ba, ba), 0.0f, 1.0f);
+  return length(pa - ba*h) - r;
+}
+
+static vec2 rotate(float c, float s, vec2 v) { // mat2(c,-s,s,c) * v
+  return vec2(c*v.x + s*v.y, -s*v.x + c*v.y);
+}
+
+static float lattice(vec3 p, vec3 x) {
+  p -= x;
+  float c = std::cos(0.35f*PI), s = std::sin(0.35f*PI);
+  vec2 xz = rotate(c, s, vec2(p.x, p.z)); p.x = xz.x; p.z = xz.y;
+  vec2 xy = rotate(c, s, vec2(p.x, p.y)); p.x = xy.x; p.y = xy.y;
+
+  const float r = 0.5f;
+  const float l = 0.5f * 3 / 1.1547f;
+  const float k = l * 0.866f;
+  vec3 p1(0, k, 0), p2(0, -k, l), p3(l, -k, -l), p4(-l, -k, -l);
+
+  float d = sphere(p, p1, r);
+  d = std::min(d, sphere(p, p2, r));
+  d = std::min(d, sphere(p, p3, r));
+  d = std::min(d, sphere(p, p4, r));
+
+  d = smin(d, line(p, p1, p2, 0.35f*r), 0.35f);
+  d = smin(d, line(p, p1, p3, 0.35f*r), 0.35f);
+  d = smin(d, line(p, p1, p4, 0.35f*r), 0.35f);
+  d = smin(d, line(p, p2, p3, 0.35f*r), 0.35f);
+  d = smin(d, line(p, p2, p4, 0.35f*r), 0.35f);
+  d = smin(d, line(p, p3, p4, 0.35f*r), 0.35f);
+  return d;
+}
+
+static float knot(vec3 p, vec3 x) {
+  const float TAU = 6.2831f;
+  p -= x;
+  float r = length(vec2(p.x, p.y));
+  float oa, a = std::atan2(p.y, p.x); oa = 1.5f*a;
+  float m = 0.001f*TAU;
+  a = a - m*std::floor(a/m) - m/2.0f;
+  p.x = r*std::cos(a); p.y = r*std::sin(a); p.x -= 6.0f;
+  vec2 xz = std::cos(oa)*vec2(p.x, p.z) + std::sin(oa)*vec2(-p.z, p.x);
+  p.x = xz.x; p.z = xz.y;
+  p.x = std::fabs(p.x) - 1.35f;
+  return 0.5f*(length(p) - 1.0f);
+}
+
+static float csg(vec3 p, vec3 x) {
+  p -= x;
+  float d = sphere(p, vec3(0), 1.35f);
+  d = std::max(d, box(p, vec3(0), vec3(1)));
+  d = std::max(d, 0.7f - length(vec2(p.x, p.y)));
+  d = std::max(d, 0.7f - length(vec2(p.x, p.z)));
+  d = std::max(d, 0.7f - length(vec2(p.y, p.z)));
+  return d;
+}
+
+static float evalPrimitive(const ScenePrimitive& o, vec3 p) {
+  const float *k = &o.params[0];
+  vec3 x(k[0], k[1], k[2]);
+  switch (o.type) {
+    case PRIMITIVE_SPHERE: return sphere(p, x, k[3]);
+    case PRIMITIVE_BOX: return box(p, x, vec3(k[3], k[4], k[5]));
+    case PRIMITIVE_TORUS: return torus(p, x, vec2(k[3], k[4]));
+    case PRIMITIVE_CONE: return cone(p, x, vec2(k[3], k[4]));
+    case PRIMITIVE_CYLINDER: return cylinder(p, x, vec2(k[3], k[4]));
+    case PRIMITIVE_DISK: return disk(p, x, vec3(k[3], k[4], k[5]), k[6]);
+    case PRIMITIVE_POLYHEDRON: {
+      float d = plane(p, x, k[3]);
+      for (size_t i = 4; i < o.params.size(); i += 4)
+        d = std::min(d, plane(p, vec3(k[i], k[i+1], k[i+2]), k[i+3]));
+      return d;
+    }
+    case PRIMITIVE_CUSTOM:
+      if (o.name == "lattice") return lattice(p, x);
+      if (o.name == "knot") return knot(p, x);
+      return csg(p, x);
+    case PRIMITIVE_MESH:
+      break;
+  }
+  return FAR;
+}
+
+// Normal analítica (calcNormal(p, id) gerado pelo ShaderGenerator). Retorna
+// false para os objetos que usam o gradiente numérico.
+static bool evalNormal(const ScenePrimitive& o, vec3 p, vec3& n) {
+  const float *k = &o.params[0];
+  vec3 x(k[0], k[1], k[2]);
+  float s = side(evalPrimitive(o, p));
+  switch (o.type) {
+    case PRIMITIVE_SPHERE: n = s * normalize(p - x); return true;
+    case PRIMITIVE_BOX: n = s * boxNormal(p, x, vec3(k[3], k[4], k[5])); return true;
+    case PRIMITIVE_TORUS: n = s * torusNormal(p, x, vec2(k[3], k[4])); return true;
+    case PRIMITIVE_CYLINDER: n = s * cylinderNormal(p, x, vec2(k[3], k[4])); return true;
+    case PRIMITIVE_POLYHEDRON: {
+      size_t best = 0;
+      float dm = plane(p, x, k[3]);
+      for (size_t i = 4; i < o.params.size(); i += 4) {
+        float di = plane(p, vec3(k[i], k[i+1], k[i+2]), k[i+3]);
+        if (di < dm) {dm = di; best = i;}
+      }
+      n = side(dm) * normalize(vec3(k[best], k[best+1], k[best+2]));
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// ====================== PATH TRACER ======================
+// Estado de um caminho: transcrição das funções do template.glsl.
+class CpuTracer {
+ public:
+  CpuTracer(const Scene& scene, const BVH& bvh, const TriangleBVH& meshBVH,
+            const DistanceField& field, const std::vector<Image>& images,
+            const std::vector<uint32_t>& sobol, const std::vector<float>& lightPDF,
+            const std::vector<LightAlias>& lightTable, int width, int height)
+    : m_scene(scene), m_bvh(bvh), m_meshBVH(meshBVH), m_field(field), m_images(images), m_sobol(sobol),
+      m_resolution(width, height), m_lightPDF(lightPDF), m_lightTable(lightTable) {}
+
+  vec3 sample(int x, int y, unsigned int sampleNumber, vec3& albedo, float normal[4]) {
+    vec2 fragCoord(x + 0.5f, y + 0.5f);
+    m_pixel[0] = x; m_pixel[1] = y;
+    m_index = sampleNumber;
+    m_dim = 0;
+
+    vec3 ro, rd;
+    buildCamera(fragCoord, ro, rd);
+    return raytrace(ro, rd, albedo, normal);
+  }
+
+  // map() exato, usado no pré-cálculo do campo de distância.
+  float distance(vec3 p) const {return map(p);}
+
+ private:
+  static void pcg4d(uint32_t v[4]) {
+    for (int i = 0; i < 4; ++i)
+      v[i] = v[i] * 1664525u + 1013904223u;
+    v[0] += v[1]*v[3]; v[1] += v[2]*v[0]; v[2] += v[0]*v[1]; v[3] += v[1]*v[2];
+    for (int i = 0; i < 4; ++i)
+      v[i] ^= v[i] >> 16;
+    v[0] += v[1]*v[3]; v[1] += v[2]*v[0]; v[2] += v[0]*v[1]; v[3] += v[1]*v[2];
+  }
+
+  static uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+  }
+
+  static uint32_t laineKarras(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+  }
+
+  static uint32_t owenScramble(uint32_t x, uint32_t seed) {
+    return reverseBits(laineKarras(reverseBits(x), seed));
+  }
+
+  static float toUnit(uint32_t x) {
+    return float(x >> 8) * (1.0f / 16777216.0f);
+  }
+
+  // Semente da próxima dimensão: pcg4d(x, y, dimensão, 0).
+  void nextDimension(uint32_t h[4]) {
+    h[0] = m_pixel[0]; h[1] = m_pixel[1]; h[2] = m_dim++; h[3] = 0;
+    pcg4d(h);
+  }
+
+  // Mesmo amostrador (Sobol com embaralhamento de Owen) do template.glsl.
+  float rand() {
+    uint32_t h[4];
+    nextDimension(h);
+    uint32_t i = owenScramble(m_index, h[0]);
+    return toUnit(reverseBits(laineKarras(i, h[1])));
+  }
+
+  vec2 rand2() {
+    uint32_t h[4];
+    nextDimension(h);
+    uint32_t i = owenScramble(m_index, h[0]);
+    uint32_t y = 0;
+    int bit = 32;
+    for (uint32_t j = i; j != 0; j >>= 1, ++bit)
+      if (j & 1u)
+        y ^= m_sobol[bit];
+    return vec2(toUnit(reverseBits(laineKarras(i, h[1]))),
+                toUnit(owenScramble(y, h[2])));
+  }
+
+  // Percorre a BVH na mesma ordem dos ifs gerados pelo ShaderGenerator.
+  void mapNode(int node, vec3 p, float& d, int& id) const {
+    const BVHNode& n = m_bvh.nodes()[node];
+    if (!(n.box.distance(p) <= std::max(d, 0.0f)))
+      return;
+    if (n.left < 0) {
+      for (int i = n.first; i < n.first + n.count; ++i)
+        mapObject(m_bvh.primitives()[i], p, d, id);
+    } else {
+      mapNode(n.left, p, d, id);
+      mapNode(n.right, p, d, id);
+    }
+  }
+
+  void mapObject(int i, vec3 p, float& d, int& id) const {
+    float aux = evalPrimitive(m_scene.objects[i], p);
+    if (aux < d) {d = aux; id = i;}
+  }
+
+  // Retorna a menor distância e o índice do objeto mais próximo (mapMat no
+  // shader).
+  float mapId(vec3 p, int& id) const {
+    float d = FAR; id = 0;
+    for (size_t i = 0; i < m_bvh.unbounded().size(); ++i)
+      mapObject(m_bvh.unbounded()[i], p, d, id);
+    if (!m_bvh.nodes().empty())
+      mapNode(0, p, d, id);
+    return d;
+  }
+
+  float map(vec3 p) const {
+    int id;
+    return mapId(p, id);
+  }
+
+  // Limite inferior de s*map(p) pelo campo pré-calculado, exato fora da
+  // grade e a menos de near da superfície (fieldMap no field.glsl).
+  float fieldMap(vec3 p, float s, float near) const {
+    float d, margin;
+    if (m_field.empty() || !m_field.coarseSample(p, d, margin))
+      return s * map(p);
+    float r = s * d - margin;
+    if (r >= std::max(near, m_field.cell()))
+      return r;
+    if (m_field.fineSample(p, d, margin))
+      r = std::max(r, s * d - margin);
+    return r >= near ? r : s * map(p);
+  }
+
+  void buildCamera(vec2 fragCoord, vec3& ro, vec3& rd) {
+    const SceneCamera& cam = m_scene.camera;
+    ro = cam.position;
+    vec3 f = normalize(ro - cam.target);
+    vec3 r = normalize(cross(normalize(cam.up), f));
+    vec3 u = normalize(cross(f, r));
+    vec2 uv = (2.0f*fragCoord - m_resolution) / m_resolution.y;
+    vec2 jitter = rand2();
+    uv = uv + 0.0055f*vec2(2.0f*jitter.x - 1.0f, 2.0f*jitter.y - 1.0f);
+    uv = uv * std::tan(0.5f*cam.fov*3.141592f/180.0f);
+    rd = normalize(r*uv.x + u*uv.y - f);
+  }
+
+  vec3 calcNormal(vec3 p) const {
+    float f = sign(map(p));
+    float h = 0.5773f * EPS;
+    vec3 a(h, -h, -h), b(-h, -h, h), c(-h, h, -h), d(h, h, h);
+    return normalize(f*(a*map(p + a) + b*map(p + b) + c*map(p + c) + d*map(p + d)));
+  }
+
+  vec3 calcNormal(vec3 p, int id) const {
+    vec3 n;
+    if (evalNormal(m_scene.objects[id], p, n))
+      return n;
+    return calcNormal(p);
+  }
+
+  // Percurso da TriangleBVH e interseção dos triângulos (mesh.glsl).
+  static float meshBox(vec3 ro, vec3 invRd, const AABB& box, float tmax) {
+    vec3 t0 = (box.lo - ro) * invRd, t1 = (box.hi - ro) * invRd;
+    vec3 tn = min(t0, t1), tf = max(t0, t1);
+    float enter = std::max(std::max(tn.x, tn.y), std::max(tn.z, 0.0f));
+    float leave = std::min(std::min(tf.x, tf.y), std::min(tf.z, tmax));
+    return enter <= leave ? enter : 1e30f;
+  }
+
+  static float meshTriangle(vec3 ro, vec3 rd, const MeshTriangle& tri, float tmax) {
+    vec3 pv = cross(rd, tri.e2);
+    float det = dot(tri.e1, pv);
+    if (det == 0.0f)
+      return -1.0f;
+    float inv = 1.0f / det;
+    vec3 tv = ro - tri.v0;
+    float u = dot(tv, pv) * inv;
+    if (u < 0.0f || u > 1.0f)
+      return -1.0f;
+    vec3 qv = cross(tv, tri.e1);
+    float v = dot(rd, qv) * inv;
+    if (v < 0.0f || u + v > 1.0f)
+      return -1.0f;
+    float t = dot(tri.e2, qv) * inv;
+    return (t > 0.0f && t < tmax) ? t : -1.0f;
+  }
+
+  float meshTraverse(vec3 ro, vec3 rd, float tmax, bool anyHit, int& hit) const {
+    const std::vector<BVHNode>& nodes = m_meshBVH.nodes();
+    const std::vector<MeshTriangle>& triangles = m_meshBVH.triangles();
+    hit = -1;
+    if (nodes.empty())
+      return -1.0f;
+    vec3 invRd(1.0f / (rd.x == 0.0f ? 1e-20f : rd.x), 1.0f / (rd.y == 0.0f ? 1e-20f : rd.y),
+               1.0f / (rd.z == 0.0f ? 1e-20f : rd.z));
+    int stackNode[64];
+    float stackT[64];
+    int top = 0;
+    float t = tmax;
+
+    int node = meshBox(ro, invRd, nodes[0].box, t) < t ? 0 : -1;
+    while (node >= 0) {
+      const BVHNode& n = nodes[node];
+      if (n.count > 0) {
+        for (int i = n.first; i < n.first + n.count; ++i) {
+          float ti = meshTriangle(ro, rd, triangles[i], t);
+          if (ti > 0.0f) {
+            t = ti;
+            hit = i;
+            if (anyHit)
+              return t;
+          }
+        }
+        node = -1;
+      } else {
+        float dl = meshBox(ro, invRd, nodes[n.left].box, t);
+        float dr = meshBox(ro, invRd, nodes[n.right].box, t);
+        node = -1;
+        if (std::min(dl, dr) < t) {
+          node = dl <= dr ? n.left : n.right;
+          if (std::max(dl, dr) < t) {
+            stackNode[top] = dl <= dr ? n.right : n.left;
+            stackT[top++] = std::max(dl, dr);
+          }
+        }
+      }
+      while (node < 0 && top > 0) {
+        --top;
+        if (stackT[top] < t)
+          node = stackNode[top];
+      }
+    }
+    return hit >= 0 ? t : -1.0f;
+  }
+
+  float traceMesh(vec3 ro, vec3 rd, float tmax, int& id, vec3& n) const {
+    int hit;
+    float t = meshTraverse(ro, rd, tmax, false, hit);
+    if (hit < 0)
+      return -1.0f;
+    const MeshTriangle& tri = m_meshBVH.triangles()[hit];
+    n = normalize(cross(tri.e1, tri.e2));
+    id = tri.object;
+    return t;
+  }
+
+  bool occludedMesh(vec3 ro, vec3 rd, float tmax) const {
+    int hit;
+    return meshTraverse(ro, rd, tmax, true, hit) >= 0.0f;
+  }
+
+  float shadowcast(vec3 ro, vec3 rd, float tmax) const {
+    if (occludedMesh(ro, rd, tmax))
+      return 0;
+    float fsign = sign(map(ro));
+    for (float t = 0; t < tmax; ) {
+      float d = fieldMap(ro + t * rd, fsign, EPS);
+      if (d < EPS)
+        return 0;
+      t += d;
+    }
+    return 1;
+  }
+
+  float raycast(vec3 ro, vec3 rd, float tmax) const {
+    float pixelRadius = 1.0f / m_resolution.y;
+
+    float functionSign = sign(map(ro));
+    float omega = 1.2f, stepLength = 0, previousRadius = 0;
+
+    float candidate_error = 10.0f*FAR, t = 0.0f;
+
+    for (int i = 0; i < ITERATIONS; ++i) {
+      float signedRadius = fieldMap(ro + t*rd, functionSign, std::max(EPS, t*pixelRadius));
+      float radius = std::fabs(signedRadius);
+
+      bool sorFail = omega > 1 && (radius + previousRadius) < stepLength;
+
+      if (sorFail) {
+        stepLength -= omega * stepLength;
+        omega = 1.0f;
+      } else {
+        stepLength = signedRadius * omega;
+      }
+      previousRadius = radius;
+
+      float error = radius / t;
+      if (!sorFail && error < candidate_error)
+        candidate_error = error;
+
+      if ((!sorFail && error < pixelRadius) || t > tmax)
+        break;
+      t += 0.8f*stepLength;
+    }
+    if (t > tmax || candidate_error > pixelRadius)
+      return -1.0f;
+    return t;
+  }
+
+  vec3 texture(const Image& img, float u, float v) const {
+    // Filtro bilinear com GL_REPEAT (sem mipmaps).
+    float x = u * img.width - 0.5f, y = v * img.height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float ax = x - fx, ay = y - fy;
+    int w = img.width, h = img.height;
+    int x0 = ((int(fx) % w) + w) % w, y0 = ((int(fy) % h) + h) % h;
+    int x1 = (x0 + 1) % w, y1 = (y0 + 1) % h;
+    auto texel = [&](int i, int j) {
+      const unsigned char *c = &img.data[3*(j*w + i)];
+      return vec3(c[0], c[1], c[2]) / 255.0f;
+    };
+    return mix(mix(texel(x0, y0), texel(x1, y0), ax),
+               mix(texel(x0, y1), texel(x1, y1), ax), ay);
+  }
+
+  vec3 checkerTexture(vec3 p, const SceneMaterial& m) const {
+    p /= m.size;
+    float s = std::floor(p.x) + std::floor(p.y) + std::floor(p.z);
+    float k = s - 2.0f * std::floor(s / 2.0f);
+    return mix(m.colorA, m.colorB, k);
+  }
+
+  vec3 cubeMap(vec3 p, vec3 n, const SceneMaterial& m) const {
+    const Image& img = m_images[m.index - 2];
+    p /= m.size;
+    vec3 a = pow(texture(img, p.y, p.z), vec3(2.2f));
+    vec3 b = pow(texture(img, p.x, p.z), vec3(2.2f));
+    vec3 c = pow(texture(img, p.x, p.y), vec3(2.2f));
+    n = abs(n);
+    return (a*n.x + b*n.y + c*n.z)/(n.x+n.y+n.z);
+  }
+
+  void getProperties(vec3 p, vec3 n, int id, vec3& tex, SceneProperties& pr) const {
+    const ScenePrimitive& o = m_scene.objects[id];
+    const SceneMaterial& m = m_scene.materials[o.material];
+    if (m.type == 0) // solid
+      tex = m.colorA;
+    else if (m.type == 1) // checkerboard
+      tex = checkerTexture(p, m);
+    else if (m.type == 2) // texmap
+      tex = cubeMap(p, n, m);
+    pr = m_scene.properties[o.property];
+  }
+
+  static float fresnel(float ior, float cosTheta) {
+    float r0 = (1.0f - ior) / (1.0f + ior);
+    r0 *= r0;
+    return r0 + (1.0f - r0) * std::pow(1.0f - std::max(0.0f, cosTheta), 5.0f);
+  }
+
+  static vec3 fresnel(vec3 r0, float cosTheta) {
+    return r0 + (1.0f - r0) * std::pow(1.0f - std::max(0.0f, cosTheta), 5.0f);
+  }
+
+  vec3 optimizeHit(vec3 p, vec3 rd, int& id) const {
+    for (int i = 0; i < 9; ++i)
+      p += rd * (std::fabs(map(p)) - 0.01f/m_resolution.y*length(p));
+    p += rd * (std::fabs(mapId(p, id)) - 0.01f/m_resolution.y*length(p));
+    return p;
+  }
+
+  static vec3 toWorldSpace(vec3 n, vec3 w) {
+    vec3 t = std::fabs(n.x) > std::fabs(n.y) ? vec3(n.z, 0.0f, -n.x) : vec3(0, -n.z, n.y);
+    t = normalize(t);
+    vec3 b = normalize(cross(n, t));
+    return normalize(b*w.x + n*w.y + t*w.z);
+  }
+
+  vec3 cosineWeightedSample() {
+    vec3 w;
+    vec2 u = rand2();
+    float r = std::sqrt(u.x);
+    float theta = TWO_PI*u.y;
+    w.x = r * std::cos(theta);
+    w.z = r * std::sin(theta);
+    w.y = std::sqrt(std::max(0.0f, 1.0f - w.x*w.x - w.z*w.z));
+    return w;
+  }
+
+  static float blinnBRDF(float alpha, float cosH) {
+    float k = (alpha + 2.0f)*(alpha + 4.0f);
+    k /= 8 * PI * (std::pow(2.0f, -0.5f*alpha) + alpha);
+    return k * std::pow(cosH, alpha);
+  }
+
+  static float blinnPDF(float alpha, float cosH, float cosWoH) {
+    return clamp((alpha + 1)/TWO_PI * std::pow(cosH, alpha) / (4.0f * cosWoH), 0.0f, 1.0f);
+  }
+
+  vec3 blinnSample(float alpha) {
+    vec3 h;
+    vec2 u = rand2();
+    float phi = TWO_PI*u.x;
+    h.y = std::pow(u.y, 1.0f / (alpha + 1.0f));
+    h.x = h.z = std::sqrt(std::max(0.0f, 1.0f - h.y*h.y));
+    h.x *= std::cos(phi); h.z *= std::sin(phi);
+    return h;
+  }
+
+
+  int sampleLightIndex() {
+    int nLights = m_lightTable.size();
+    float k = rand() * float(nLights);
+    int i = std::min(int(k), nLights - 1);
+    return k - float(i) < m_lightTable[i].probability ? i : m_lightTable[i].alias;
+  }
+
+  vec3 sampleCone(float cosThetaMax) {
+    vec2 u = rand2();
+    float cosTheta = (1 - u.x) + u.x * cosThetaMax;
+    float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta*cosTheta));
+    float phi = TWO_PI * u.y;
+    return vec3(std::cos(phi) * sinTheta, cosTheta, std::sin(phi) * sinTheta);
+  }
+
+  static float iSphere(vec3 ro, vec3 rd, vec3 c, float radius) {
+    vec3 oc = ro - c;
+    float b = dot(oc, rd);
+    float cc = dot(oc, oc) - radius * radius;
+    float h = b * b - cc;
+    if (h < 0.0f) return -1.0f;
+
+    float s = std::sqrt(h);
+    float t1 = -b - s;
+    float t2 = -b + s;
+    return t1 < 0.0f ? t2 : t1;
+  }
+
+  vec3 sampleSphere(vec3 p, vec3 c, float radius, float& pdf) {
+    vec3 l = c - p;
+    float sinThetaMax2 = radius * radius / dot(l, l);
+    float cosThetaMax = std::sqrt(std::max(0.0f, 1 - sinThetaMax2));
+    vec3 s = sampleCone(cosThetaMax);
+    s = toWorldSpace(normalize(l), s);
+    float t = iSphere(p, s, c, radius);
+    if (t == -1)
+      t = std::max(0.0f, dot(c - p, s));
+    pdf = (std::fabs(cosThetaMax - 1) < 1E-8f) ? 0 : 1.0f / (TWO_PI * (1.0f - cosThetaMax));
+    pdf = clamp(pdf, 0.0f, 1.0f);
+    return p + t * s;
+  }
+
+  vec3 directLight(vec3 rd, vec3 n, vec3 p, bool inside, float offset, vec3 tex,
+                   const SceneProperties& pr) {
+    if (inside || pr.kr > 0 || pr.kt > 0 || m_lightPDF.empty())
+      return vec3(0.0f);
+
+    float pdf = 0;
+    vec3 col(0.0f), lightPos(0.0f);
+
+    int i = sampleLightIndex();
+    const SceneLight& light = m_scene.lights[i];
+
+    if (light.type == 0) {
+      lightPos = light.position; pdf = 1;
+    } else {
+      lightPos = sampleSphere(p, light.position, light.radius + 2.0f*EPS2, pdf);
+      if (pdf == 0) return vec3(0.0f);
+    }
+    vec3 l = lightPos - p;
+    float d = std::sqrt(dot(l, l)); l /= d;
+    float lamb = dot(n, l);
+
+    if (lamb <= 0) return col;
+    lamb = std::fabs(lamb);
+
+    if (light.type == 1) {
+      vec3 ln = normalize(lightPos - light.position);
+      if (dot(ln, -l) <= 0) return vec3(0.0f);
+    }
+
+    float shadow = shadowcast(p + offset*n, l, d);
+    vec3 h = normalize(l - rd);
+    vec3 fre = fresnel(tex, dot(h, -rd));
+    float prob = maxComponent(fre);
+    if (pr.alpha > 0 && rand() < prob) {
+      // blinn-phong
+      col += fre * blinnBRDF(pr.alpha, std::fabs(dot(n, h))) / prob;
+    } else if (pr.alpha > 0) {
+      // difuso blinn-phong
+      col += (1.0f-fre) * tex * INV_PI / (1.0f-prob);
+    } else {
+      // difuso
+      col += tex*INV_PI;
+    }
+    col *= shadow * lamb * light.color;
+    col /= d * d * m_lightPDF[i] * pdf;
+    return col + pr.emission;
+  }
+
+  static vec3 getBgColor(vec3 rd) {
+    return 0.5f*vec3(0.7f, 0.8f, 1.0f)*(1.0f-0.5f*rd.y);
+  }
+
+  // Também devolve os dados auxiliares do denoiser, como no template.glsl.
+  vec3 raytrace(vec3 ro, vec3 rd, vec3& albedo, float normal[4]) {
+    vec3 L(0.0f);
+    vec3 pathThroughput(1.0f);
+    bool specularBounce = false;
+    bool auxDone = false;
+    albedo = vec3(1.0f);
+    normal[0] = normal[1] = normal[2] = 0.0f;
+    normal[3] = FAR;
+    float depth = 0.0f;
+
+    for (int i = 0; i < BOUNCES; ++i) {
+      int id = 0;
+      vec3 n;
+      float t = traceMesh(ro, rd, FAR, id, n);
+      bool meshHit = t >= 0;
+      float tSDF = raycast(ro, rd, meshHit ? t : FAR);
+      if (tSDF >= 0) {
+        t = tSDF;
+        meshHit = false;
+      }
+      if (t < 0) {
+        // calcula iluminação direta para luzes especulares
+        // somente se o último raio a bater for especular.
+        if (specularBounce)
+          for (size_t j = 0; j < m_scene.lights.size(); ++j) {
+            const SceneLight& light = m_scene.lights[j];
+            if (light.type == 0) {
+              float k = dot(light.position - ro, light.position - ro);
+              L += pathThroughput * light.color / k;
+            }
+          }
+        L += pathThroughput * getBgColor(rd);
+        break;
+      }
+
+      // Informações do ponto de colisão.
+      vec3 p;
+      bool inside;
+      float offset;
+      if (meshHit) {
+        p = ro + t*rd;
+        inside = dot(n, rd) > 0;
+        n = inside ? -n : n;
+        offset = EPS2;
+      } else {
+        p = optimizeHit(ro + t*rd, rd, id);
+        n = calcNormal(p, id);
+        float d = map(p);
+        inside = d < 0;
+        offset = std::max(EPS2, 2.0f*std::fabs(d));
+      }
+
+      // Informações do material.
+      vec3 tex; SceneProperties pr;
+      getProperties(p, n, id, tex, pr);
+
+      if (!auxDone) {
+        albedo *= tex;
+        depth += t;
+        auxDone = pr.kt <= 0 && pr.kr <= 0;
+        if (auxDone) {
+          normal[0] = n.x; normal[1] = n.y; normal[2] = n.z;
+          normal[3] = depth;
+        }
+      }
+
+      if (i == 0 || specularBounce)
+        L += pathThroughput * pr.emission;
+      L += pathThroughput * directLight(rd, n, p, inside, offset, tex, pr);
+
+      float flip = 1;
+      if (pr.kt > 0) {
+        // Transmissão (BSTF) com reflexões internas e fresnel
+        float ior = inside ? 1.0f/pr.ior : pr.ior;
+        float fre = fresnel(ior, dot(-rd, n));
+
+        if (rand() < fre) {
+          pathThroughput *= tex;
+          rd = reflect(rd, n);
+        } else {
+          rd = refract(rd, n, 1.0f/ior);
+          if (rd == vec3(0.0f))
+            break;
+          pathThroughput *= tex*ior*ior;
+          flip = -1;
+        }
+        specularBounce = true;
+      } else if (pr.kr > 0) {
+        // Especular (BRDF) com fresnel
+        pathThroughput *= fresnel(tex, dot(-rd, n));
+        rd = reflect(rd, n);
+        specularBounce = true;
+      } else if (pr.alpha > 0) {
+        // Blinn-Phong BRDF com fresnel
+        vec3 h = blinnSample(pr.alpha);
+        float cosH = std::fabs(h.y);
+        vec3 fre = fresnel(tex, cosH);
+        float prob = maxComponent(fre);
+        if (rand() < prob) {
+          h = toWorldSpace(n, h);
+          float cosWoH = std::fabs(dot(-rd, h));
+          rd = reflect(rd, h);
+          float pdf = blinnPDF(pr.alpha, cosH, cosWoH);
+          if (pdf <= 1E-6f) break;
+          pathThroughput *= fre * blinnBRDF(pr.alpha, cosH) * std::max(0.0f, dot(n, rd));
+          pathThroughput /= pdf * prob;
+        } else {
+          rd = cosineWeightedSample();
+          rd = toWorldSpace(n, rd);
+          pathThroughput *= tex * (1.0f-fre) / (1.0f - prob);
+        }
+        specularBounce = false;
+      } else {
+        // Difuso (BRDF)
+        rd = cosineWeightedSample();
+        rd = toWorldSpace(n, rd);
+        pathThroughput *= tex;
+        specularBounce = false;
+      }
+
+      // roleta russa
+      if (i > 5) {
+        float k = maxComponent(pathThroughput);
+        float continueProbability = std::min(0.8f, k);
+        if (rand() > continueProbability)
+          break;
+        pathThroughput /= continueProbability;
+      }
+
+      pathThroughput = clamp(pathThroughput, 0.0f, 1.0f);
+      ro = p + flip*offset*n;
+    }
+
+    return L;
+  }
+
+  const Scene& m_scene;
+  const BVH& m_bvh;
+  const TriangleBVH& m_meshBVH;
+  const DistanceField& m_field;
+  const std::vector<Image>& m_images;
+  const std::vector<uint32_t>& m_sobol; // matrizes de sobol.hpp
+  vec2 m_resolution;
+  const std::vector<float>& m_lightPDF;        // lightDistribution da cena
+  const std::vector<LightAlias>& m_lightTable; // tabela de alias sobre ela
+  uint32_t m_pixel[2];
+  uint32_t m_index;    // amostra atual
+  uint32_t m_dim;      // próxima dimensão
+};
+
+// ====================== ESCALONADOR ======================
+// Cada thread tem uma fila própria de blocos. Quando ela esvazia, a thread
+// rouba blocos do final da fila das outras.
+class TileScheduler {
+ public:
+  TileScheduler(int tiles, int workers) : m_queues(workers), m_locks(workers) {
+    for (int i = 0; i < tiles; ++i)
+      m_queues[i % workers].push_back(i);
+  }
+
+  bool next(int worker, int& tile) {
+    {
+      std::lock_guard<std::mutex> lock(m_locks[worker]);
+      if (!m_queues[worker].empty()) {
+        tile = m_queues[worker].front();
+        m_queues[worker].pop_front();
+        return true;
+      }
+    }
+    int n = m_queues.size();
+    for (int i = 1; i < n; ++i) {
+      int victim = (worker + i) % n;
+      std::lock_guard<std::mutex> lock(m_locks[victim]);
+      if (!m_queues[victim].empty()) {
+        tile = m_queues[victim].back();
+        m_queues[victim].pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  std::vector<std::deque<int> > m_queues;
+  std::vector<std::mutex> m_locks;
+};
+
+// ====================== CPU RENDERER ======================
+CpuRenderer::CpuRenderer(const Scene& scene, int width, int height, int threads)
+  : m_scene(scene), m_bvh(m_scene.objects), m_meshBVH(m_scene.meshes), m_sobol(sobolMatrices()),
+    m_lightPDF(lightDistribution(m_scene.lights)), m_lightTable(lightAliasTable(m_lightPDF)), m_width(width), m_height(height),
+    m_threads(threads), m_samples(0), m_adaptive(0.0f), m_adaptiveMin(32), m_converged(false) {
+  if (m_width <= 0 || m_height <= 0)
+    throw std::runtime_error("O tamanho da imagem é inválido!");
+
+  for (size_t i = 0; i < m_scene.objects.size(); ++i) {
+    const ScenePrimitive& o = m_scene.objects[i];
+    if (o.type == PRIMITIVE_CUSTOM && o.name != "lattice" &&
+        o.name != "knot" && o.name != "csg")
+      throw std::runtime_error("Objeto não suportado no modo CPU: " + o.name);
+  }
+
+  for (size_t i = 0; i < m_scene.materials.size(); ++i) {
+    const SceneMaterial& m = m_scene.materials[i];
+    if (m.type == 2) {
+      PPMReader reader(m.texture);
+      m_images.push_back(reader.read());
+    }
+  }
+
+  if (m_threads <= 0)
+    m_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  m_tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+  m_tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+  m_sum.assign(3 * m_width * m_height, 0.0f);
+  m_sum2.assign(m_width * m_height, 0.0f);
+  m_count.assign(m_width * m_height, 0);
+  m_albedo.assign(4 * m_width * m_height, 0.0f);
+  m_normal.assign(4 * m_width * m_height, 0.0f);
+}
+
+static float luminance(vec3 c) {
+  return dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Mesmo critério do pixelError() do template.glsl.
+float CpuRenderer::pixelError(int pixel) const {
+  float n = m_count[pixel];
+  if (n < std::max(m_adaptiveMin, 2u))
+    return 1e30f;
+  const float *sum = &m_sum[3 * pixel];
+  float mean = luminance(vec3(sum[0] / n, sum[1] / n, sum[2] / n));
+  float m2 = m_sum2[pixel] / n;
+  return std::sqrt(std::max(m2 - mean*mean, 0.0f) / (n - 1.0f)) / (mean + ERROR_FLOOR);
+}
+
+// Cada pixel continua a partir do próprio contador de amostras; os que já
+// atingiram o erro desejado são pulados.
+void CpuRenderer::renderTile(int tile, unsigned int count) {
+  CpuTracer tracer(m_scene, m_bvh, m_meshBVH, m_field, m_images, m_sobol, m_lightPDF, m_lightTable,
+                   m_width, m_height);
+  int x0 = (tile % m_tilesX) * TILE_SIZE, y0 = (tile / m_tilesX) * TILE_SIZE;
+  int x1 = std::min(x0 + TILE_SIZE, m_width), y1 = std::min(y0 + TILE_SIZE, m_height);
+
+  for (int y = y0; y < y1; ++y)
+    for (int x = x0; x < x1; ++x) {
+      int pixel = y * m_width + x;
+      if (m_adaptive > 0.0f && pixelError(pixel) < m_adaptive)
+        continue;
+      vec3 col(0.0f);
+      float l2 = 0.0f;
+      float *albedo = &m_albedo[4 * pixel], *normal = &m_normal[4 * pixel];
+      unsigned int first = m_count[pixel];
+      for (unsigned int s = first; s < first + count; ++s) {
+        vec3 a;
+        float g[4];
+        vec3 c = tracer.sample(x, y, s, a, g);
+        col += c;
+        l2 += luminance(c) * luminance(c);
+        albedo[0] += a.x; albedo[1] += a.y; albedo[2] += a.z;
+        for (int i = 0; i < 4; ++i)
+          normal[i] += g[i];
+      }
+      albedo[3] += count;
+      float *sum = &m_sum[3 * pixel];
+      sum[0] += col.x; sum[1] += col.y; sum[2] += col.z;
+      m_sum2[pixel] += l2;
+      m_count[pixel] += count;
+    }
+}
+
+void CpuRenderer::render(unsigned int samples) {
+  TileScheduler scheduler(m_tilesX * m_tilesY, m_threads);
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < m_threads; ++i)
+    workers.push_back(std::thread([this, &scheduler, i, samples]() {
+      int tile;
+      while (scheduler.next(i, tile))
+        renderTile(tile, samples);
+    }));
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+
+  m_samples += samples;
+  if (m_adaptive > 0.0f) {
+    m_converged = true;
+    for (int i = 0; i < m_width * m_height && m_converged; ++i)
+      m_converged = pixelError(i) < m_adaptive;
+  }
+}
+
+// Pré-calcula o campo de distância com o map() do CpuTracer, dividindo
+// cada lote de pontos em partes contíguas entre as threads.
+void CpuRenderer::bakeField(int resolution) {
+  DistanceField empty;
+  CpuTracer tracer(m_scene, m_bvh, m_meshBVH, empty, m_images, m_sobol, m_lightPDF, m_lightTable,
+                   m_width, m_height);
+  m_field.bake(m_scene, resolution, [&](const std::vector<vec3>& p, std::vector<float>& d) {
+    d.resize(p.size());
+    std::vector<std::thread> workers;
+    for (int i = 0; i < m_threads; ++i)
+      workers.push_back(std::thread([&, i]() {
+        size_t first = p.size() * i / m_threads, last = p.size() * (i + 1) / m_threads;
+        for (size_t j = first; j < last; ++j)
+          d[j] = tracer.distance(p[j]);
+      }));
+    for (size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
+  });
+}
+
+std::vector<float> CpuRenderer::getImage() const {
+  std::vector<float> image(m_sum.size(), 0.0f);
+  for (size_t i = 0; i < m_sum.size(); ++i)
+    if (m_count[i / 3] > 0)
+      image[i] = m_sum[i] / m_count[i / 3];
+  return image;
+}
+
+// Soma dos quadrados da luminância, amostras e erro de cada pixel, no
+// formato dos momentos do checkpoint.
+std::vector<float> CpuRenderer::getMoments() const {
+  std::vector<float> moments(3 * m_count.size());
+  for (size_t i = 0; i < m_count.size(); ++i) {
+    moments[3*i] = m_sum2[i];
+    moments[3*i + 1] = m_count[i];
+    moments[3*i + 2] = pixelError(i);
+  }
+  return moments;
+}
+
+// Buffers do denoiser no formato do Renderer: momentos com E[L²] e as somas
+// do albedo (com o número de amostras) e da normal (com a profundidade).
+// Os auxiliares não vão para o checkpoint e recomeçam do zero ao retomar.
+void CpuRenderer::getAuxiliary(std::vector<float>& moments, std::vector<float>& albedo,
+                               std::vector<float>& normal) const {
+  moments = getMoments();
+  for (size_t i = 0; i < m_count.size(); ++i)
+    if (m_count[i] > 0)
+      moments[3*i] /= m_count[i];
+  albedo = m_albedo;
+  normal = m_normal;
+}
+
+// Continua a partir da soma salva em um checkpoint; a próxima amostra é a
+// de índice samples, como em uma renderização sem interrupção.
+void CpuRenderer::resume(const std::vector<float>& sum, const std::vector<float>& moments,
+                         unsigned int samples) {
+  if (sum.size() != m_sum.size() || moments.size() != sum.size())
+    throw std::runtime_error("O checkpoint tem tamanho diferente da imagem!");
+  m_sum = sum;
+  for (size_t i = 0; i < m_count.size(); ++i) {
+    m_sum2[i] = moments[3*i];
+    m_count[i] = moments[3*i + 1];
+  }
+  m_samples = samples;
+}
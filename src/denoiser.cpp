@@ -0,0 +1,116 @@
+#include "denoiser.hpp"
+#include "vecmath.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+
+// Núcleo B3-spline 5x5 do à-trous.
+static const float KERNEL[5] = {1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16};
+
+static float luminance(vec3 c) {
+  return dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Executa f(y) para cada linha, dividindo as linhas entre as threads.
+template <typename F>
+static void forEachRow(int height, F f) {
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+    workers.push_back(std::thread([t, threads, height, &f]() {
+      for (int y = t; y < height; y += threads)
+        f(y);
+    }));
+  for (size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+}
+
+std::vector<float> denoise(const std::vector<float>& image, const std::vector<float>& moments,
+                           const std::vector<float>& albedo, const std::vector<float>& normal,
+                           int width, int height) {
+  size_t pixels = size_t(width) * height;
+  if (image.size() != 3 * pixels || moments.size() != 3 * pixels ||
+      albedo.size() != 4 * pixels || normal.size() != 4 * pixels)
+    throw std::runtime_error("Os buffers do denoiser têm tamanho diferente da imagem!");
+
+  // Médias dos buffers auxiliares, iluminação (cor sobre albedo) e
+  // variância da média da luminância de cada pixel.
+  std::vector<vec3> a(pixels), n(pixels), color(pixels), next(pixels);
+  std::vector<float> z(pixels), variance(pixels), sigma(pixels);
+  for (size_t p = 0; p < pixels; ++p) {
+    float count = albedo[4*p + 3];
+    if (count > 0.0f) {
+      a[p] = vec3(albedo[4*p], albedo[4*p + 1], albedo[4*p + 2]) / count;
+      n[p] = vec3(normal[4*p], normal[4*p + 1], normal[4*p + 2]) / count;
+      z[p] = normal[4*p + 3] / count;
+    } else {
+      a[p] = vec3(1.0f);
+      z[p] = 0.0f;
+    }
+    a[p] = max(a[p], DENOISE_ALBEDO_FLOOR);
+
+    vec3 c(image[3*p], image[3*p + 1], image[3*p + 2]);
+    float samples = moments[3*p + 1], mean = luminance(c);
+    float v = std::max(moments[3*p] - mean*mean, 0.0f) / (samples - 1.0f);
+    variance[p] = (samples < 2.0f) ? 1e30f : (std::isfinite(v) ? v : 0.0f);
+
+    // Pixels inválidos (NaN) não se espalham pela vizinhança.
+    if (!std::isfinite(c.x) || !std::isfinite(c.y) || !std::isfinite(c.z))
+      c = vec3(0.0f);
+    color[p] = c / a[p];
+  }
+
+  // A variância de um pixel com poucas amostras é ruidosa; a média 3x3
+  // estabiliza a tolerância de luminância.
+  forEachRow(height, [&](int y) {
+    for (int x = 0; x < width; ++x) {
+      float sum = 0.0f;
+      for (int dy = -1; dy <= 1; ++dy)
+        for (int dx = -1; dx <= 1; ++dx) {
+          int qx = std::min(std::max(x + dx, 0), width - 1);
+          int qy = std::min(std::max(y + dy, 0), height - 1);
+          sum += variance[qy * width + qx];
+        }
+      size_t p = size_t(y) * width + x;
+      sigma[p] = DENOISE_SIGMA_LUMINANCE * std::sqrt(sum / 9.0f) / luminance(a[p]);
+    }
+  });
+
+  for (int i = 0; i < DENOISE_ITERATIONS; ++i) {
+    int step = 1 << i;
+    float scale = 1.0f / step; // a tolerância cai à metade a cada passo
+    forEachRow(height, [&](int y) {
+      for (int x = 0; x < width; ++x) {
+        size_t p = size_t(y) * width + x;
+        float lp = luminance(color[p]);
+        vec3 sum(0.0f);
+        float weights = 0.0f;
+        for (int dy = -2; dy <= 2; ++dy)
+          for (int dx = -2; dx <= 2; ++dx) {
+            int qx = std::min(std::max(x + dx*step, 0), width - 1);
+            int qy = std::min(std::max(y + dy*step, 0), height - 1);
+            size_t q = size_t(qy) * width + qx;
+            vec3 dn = n[q] - n[p];
+            float dist = step * std::sqrt(float(dx*dx + dy*dy));
+            float e = std::fabs(luminance(color[q]) - lp) / (sigma[p] * scale + 1e-4f) +
+                      dot(dn, dn) / (DENOISE_SIGMA_NORMAL * DENOISE_SIGMA_NORMAL) +
+                      std::fabs(z[q] - z[p]) / (DENOISE_SIGMA_DEPTH * z[p] * dist + 1e-4f);
+            float w = KERNEL[dx + 2] * KERNEL[dy + 2] * std::exp(-e);
+            sum += w * color[q];
+            weights += w;
+          }
+        next[p] = sum / weights;
+      }
+    });
+    color.swap(next);
+  }
+
+  std::vector<float> result(3 * pixels);
+  for (size_t p = 0; p < pixels; ++p) {
+    vec3 c = color[p] * a[p];
+    result[3*p] = c.x; result[3*p + 1] = c.y; result[3*p + 2] = c.z;
+  }
+  return result;
+}
@@ -0,0 +1,161 @@
+#include "distance_field.hpp"
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// A grade cobre os objetos limitados, a posição dos objetos externos (de
+// extensão desconhecida) e a câmera, com uma folga do tamanho do maior lado
+// em cada direção (paredes e chão costumam ficar em volta dos objetos).
+// Fora dela a marcha usa o map() exato, então a caixa só afeta a
+// velocidade, nunca o resultado.
+static AABB fieldBounds(const Scene& scene) {
+  AABB box(scene.camera.position, scene.camera.position);
+  for (auto it = scene.objects.begin(); it != scene.objects.end(); ++it) {
+    AABB b;
+    if (it->type == PRIMITIVE_MESH)
+      continue;
+    if (primitiveBounds(*it, b))
+      box.extend(b);
+    else if (it->type == PRIMITIVE_CUSTOM)
+      box.extend(AABB(vec3(it->params[0], it->params[1], it->params[2]),
+                      vec3(it->params[0], it->params[1], it->params[2])));
+  }
+  float pad = std::max(maxComponent(box.hi - box.lo), 1.0f);
+  return AABB(box.lo - pad, box.hi + pad);
+}
+
+// resolution é o número de células no maior eixo da caixa.
+void DistanceField::bake(const Scene& scene, int resolution, const FieldEvaluator& evaluate) {
+  if (resolution <= 0)
+    throw std::runtime_error("A resolução do campo de distância precisa ser positiva!");
+
+  AABB box = fieldBounds(scene);
+  vec3 size = box.hi - box.lo;
+  m_lo = box.lo;
+  m_cell = maxComponent(size) / resolution;
+  for (int a = 0; a < 3; ++a)
+    m_cells[a] = std::max(1, int(std::ceil(size[a] / m_cell)));
+  int nx = m_cells[0], ny = m_cells[1], nz = m_cells[2];
+
+  // Nível grosso: map() nos vértices das células.
+  std::vector<vec3> points;
+  points.reserve((nx + 1) * (ny + 1) * (nz + 1));
+  for (int z = 0; z <= nz; ++z)
+    for (int y = 0; y <= ny; ++y)
+      for (int x = 0; x <= nx; ++x)
+        points.push_back(m_lo + m_cell * vec3(x, y, z));
+  evaluate(points, m_coarse);
+
+  // Uma célula cujos vértices estão todos a mais de reach da superfície
+  // tem o mesmo sinal em toda parte, e o limite inferior dentro dela é de
+  // pelo menos band; as demais ganham um bloco fino.
+  float band = 0.5f * m_cell, reach = band + FIELD_MARGIN * m_cell;
+  std::vector<int> cells;
+  m_index.assign(nx * ny * nz, -1);
+  for (int z = 0; z < nz; ++z)
+    for (int y = 0; y < ny; ++y)
+      for (int x = 0; x < nx; ++x) {
+        float nearest = 1e30f;
+        for (int k = 0; k < 8; ++k) {
+          int corner = ((z + (k >> 2)) * (ny + 1) + y + ((k >> 1) & 1)) * (nx + 1) + x + (k & 1);
+          nearest = std::min(nearest, std::fabs(m_coarse[corner]));
+        }
+        if (nearest < reach) {
+          m_index[cellIndex(x, y, z)] = cells.size();
+          cells.push_back(cellIndex(x, y, z));
+        }
+      }
+  m_brickCount = cells.size();
+
+  // Nível fino: FIELD_BRICK³ amostras por célula, das faces inclusive.
+  points.clear();
+  points.reserve(m_brickCount * FIELD_BRICK * FIELD_BRICK * FIELD_BRICK);
+  for (size_t b = 0; b < cells.size(); ++b) {
+    vec3 corner(cells[b] % nx, (cells[b] / nx) % ny, cells[b] / (nx * ny));
+    for (int k = 0; k < FIELD_BRICK; ++k)
+      for (int j = 0; j < FIELD_BRICK; ++j)
+        for (int i = 0; i < FIELD_BRICK; ++i)
+          points.push_back(m_lo + m_cell * (corner + vec3(i, j, k) / float(FIELD_BRICK - 1)));
+  }
+  m_bricks.clear();
+  if (!points.empty())
+    evaluate(points, m_bricks);
+
+  // Atlas aproximadamente cúbico, para caber no limite de GL_TEXTURE_3D.
+  int side = 1;
+  while (side * side * side < m_brickCount)
+    ++side;
+  m_atlas[0] = m_atlas[1] = side;
+  m_atlas[2] = std::max(1, (m_brickCount + side * side - 1) / (side * side));
+}
+
+// Os blocos ficam contíguos em m_bricks (uma consulta na CPU toca um só
+// bloco); a GPU os recebe lado a lado em uma textura 3D.
+std::vector<float> DistanceField::atlasTexels() const {
+  int sx = m_atlas[0] * FIELD_BRICK, sy = m_atlas[1] * FIELD_BRICK;
+  std::vector<float> texels(sx * sy * m_atlas[2] * FIELD_BRICK, 0.0f);
+  const float *src = m_bricks.empty() ? NULL : &m_bricks[0];
+  for (int b = 0; b < m_brickCount; ++b) {
+    int bx = b % m_atlas[0], by = (b / m_atlas[0]) % m_atlas[1], bz = b / (m_atlas[0] * m_atlas[1]);
+    for (int k = 0; k < FIELD_BRICK; ++k)
+      for (int j = 0; j < FIELD_BRICK; ++j)
+        for (int i = 0; i < FIELD_BRICK; ++i) {
+          int x = bx * FIELD_BRICK + i, y = by * FIELD_BRICK + j, z = bz * FIELD_BRICK + k;
+          texels[(z * sy + y) * sx + x] = *src++;
+        }
+  }
+  return texels;
+}
+
+// Interpolação entre as amostras (x, y, z) e (x+1, y+1, z+1) de um volume
+// com sx por sy amostras em cada fatia, como o filtro GL_LINEAR.
+float DistanceField::trilinear(const float *data, int sx, int sy, int x, int y, int z, vec3 f) {
+  const float *c = data + (z * sy + y) * sx + x;
+  int dy = sx, dz = sx * sy;
+  float c00 = mix(c[0], c[1], f.x), c10 = mix(c[dy], c[dy + 1], f.x);
+  float c01 = mix(c[dz], c[dz + 1], f.x), c11 = mix(c[dz + dy], c[dz + dy + 1], f.x);
+  return mix(mix(c00, c10, f.y), mix(c01, c11, f.y), f.z);
+}
+
+// Posição de p em células, se estiver dentro da grade.
+bool DistanceField::locate(vec3 p, vec3& q) const {
+  q = (p - m_lo) / m_cell;
+  return q.x >= 0 && q.y >= 0 && q.z >= 0 && q.x < m_cells[0] && q.y < m_cells[1] &&
+         q.z < m_cells[2];
+}
+
+// As duas consultas seguem o fieldMap() do field.glsl.
+bool DistanceField::coarseSample(vec3 p, float& d, float& margin) const {
+  vec3 q;
+  if (!locate(p, q))
+    return false;
+  int x = int(q.x), y = int(q.y), z = int(q.z);
+  d = trilinear(&m_coarse[0], m_cells[0] + 1, m_cells[1] + 1, x, y, z, q - vec3(x, y, z));
+  margin = FIELD_MARGIN * m_cell;
+  return true;
+}
+
+bool DistanceField::fineSample(vec3 p, float& d, float& margin) const {
+  vec3 q;
+  if (!locate(p, q))
+    return false;
+  int x = int(q.x), y = int(q.y), z = int(q.z);
+  int brick = m_index[cellIndex(x, y, z)];
+  if (brick < 0)
+    return false;
+
+  // Posição dentro do bloco, em amostras; o último intervalo vai até a face.
+  vec3 l = clamp(q - vec3(x, y, z), 0.0f, 1.0f) * float(FIELD_BRICK - 1);
+  int i = std::min(int(l.x), FIELD_BRICK - 2), j = std::min(int(l.y), FIELD_BRICK - 2);
+  int k = std::min(int(l.z), FIELD_BRICK - 2);
+  d = trilinear(&m_bricks[brick * FIELD_BRICK * FIELD_BRICK * FIELD_BRICK], FIELD_BRICK,
+                FIELD_BRICK, i, j, k, l - vec3(i, j, k));
+  margin = FIELD_MARGIN * m_cell / (FIELD_BRICK - 1);
+  return true;
+}
+
+size_t DistanceField::bytes() const {
+  size_t atlas = size_t(m_atlas[0]) * m_atlas[1] * m_atlas[2] * FIELD_BRICK * FIELD_BRICK * FIELD_BRICK;
+  return (m_coarse.size() + atlas) * sizeof(float) + m_index.size() * sizeof(int);
+}
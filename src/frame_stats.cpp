@@ -0,0 +1,192 @@
+#include "frame_stats.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+static const char *STAGE_NAMES[FrameStats::STAGES] = {"trace", "denoise", "blit"};
+
+// Cópia da saída padrão original, depois de reserveStdout().
+static int reservedStdout = -1;
+
+void FrameStats::reserveStdout() {
+  if (reservedStdout >= 0)
+    return;
+  std::cout.flush();
+  reservedStdout = dup(STDOUT_FILENO);
+  if (reservedStdout < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+    throw std::runtime_error("Não foi possível reservar a saída padrão");
+}
+
+static std::string jsonString(const std::string& s) {
+  std::string out = "\"";
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\')
+      out += '\\';
+    if ((unsigned char) s[i] >= 0x20)
+      out += s[i];
+  }
+  return out + "\"";
+}
+
+void FrameStats::open(const std::string& path, const std::string& renderer, int width, int height) {
+  m_json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+  if (path == "-") {
+    reserveStdout();
+    m_fd = reservedStdout;
+  } else {
+    m_file.open(path.c_str());
+    if (!m_file.is_open())
+      throw std::runtime_error("Não foi possível criar o arquivo " + path);
+  }
+  m_enabled = true;
+  m_width = width;
+  m_height = height;
+  m_start = Clock::now();
+
+  std::ostringstream out;
+  if (m_json) {
+    out << "{\n  \"renderer\": " << jsonString(renderer) << ",\n"
+        << "  \"width\": " << width << ",\n  \"height\": " << height << ",\n"
+        << "  \"frames\": [";
+  } else {
+    out << "frame,samples,rays,cpu_ms,trace_ms,denoise_ms,blit_ms,samples_per_s,rays_per_s\n";
+  }
+  output(out.str());
+}
+
+void FrameStats::output(const std::string& text) {
+  if (m_fd < 0) {
+    m_file << text;
+    return;
+  }
+  for (size_t done = 0; done < text.size();) {
+    ssize_t n = ::write(m_fd, text.data() + done, text.size() - done);
+    if (n <= 0)
+      break;
+    done += n;
+  }
+}
+
+void FrameStats::beginFrame() {
+  if (!m_enabled)
+    return;
+  m_current.id = m_frame;
+  m_current.work = 0.0;
+  m_current.pending = 0;
+  for (int i = 0; i < STAGES; ++i)
+    m_current.gpuMs[i] = -1.0;
+  m_begin = Clock::now();
+}
+
+// Fecha o quadro em andamento: o tempo de CPU vai de beginFrame() até aqui.
+void FrameStats::endFrame(unsigned int samples) {
+  if (!m_enabled)
+    return;
+  std::chrono::duration<double, std::milli> cpu = Clock::now() - m_begin;
+  m_current.cpuMs = cpu.count();
+  m_current.samples = samples;
+  m_frames.push_back(m_current);
+  m_frame++;
+  flush(false);
+}
+
+void FrameStats::gpuTime(unsigned int frame, Stage stage, double ms) {
+  if (!m_enabled)
+    return;
+  for (size_t i = 0; i < m_frames.size(); ++i)
+    if (m_frames[i].id == frame) {
+      m_frames[i].gpuMs[stage] = ms;
+      m_frames[i].pending--;
+      break;
+    }
+  flush(false);
+}
+
+// Grava, em ordem, os quadros cujas consultas já chegaram (todos, se all).
+void FrameStats::flush(bool all) {
+  while (!m_frames.empty() && (all || m_frames.front().pending <= 0)) {
+    write(m_frames.front());
+    m_frames.pop_front();
+  }
+}
+
+void FrameStats::write(const Frame& frame) {
+  const Frame& f = frame;
+  m_cpuMs += f.cpuMs;
+  m_work += f.work;
+  for (int i = 0; i < STAGES; ++i)
+    if (f.gpuMs[i] >= 0.0) {
+      m_gpuMs[i] += f.gpuMs[i];
+      m_measured[i]++;
+    }
+  if (f.gpuMs[TRACE] > 0.0)
+    m_timedWork += f.work;
+
+  // Vazão pelo tempo de GPU do traçado; cada amostra de pixel é um raio
+  // de câmera (os raios secundários não são contados).
+  double rays = (f.gpuMs[TRACE] > 0.0) ? f.work / (f.gpuMs[TRACE] * 1e-3) : -1.0;
+  double samples = (rays >= 0.0) ? rays / (double(m_width) * m_height) : -1.0;
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(4);
+  const char *none = m_json ? "null" : "";
+  if (m_json)
+    out << (m_rows ? ",\n" : "\n") << "    {\"frame\": " << f.id << ", \"samples\": " << f.samples
+        << ", \"rays\": " << (long long) f.work << ", \"cpu_ms\": " << f.cpuMs;
+  else
+    out << f.id << ',' << f.samples << ',' << (long long) f.work << ',' << f.cpuMs;
+  for (int i = 0; i < STAGES; ++i) {
+    out << (m_json ? ", \"" + std::string(STAGE_NAMES[i]) + "_ms\": " : ",");
+    if (f.gpuMs[i] >= 0.0) out << f.gpuMs[i]; else out << none;
+  }
+  out << (m_json ? ", \"samples_per_s\": " : ",");
+  if (samples >= 0.0) out << samples; else out << none;
+  out << (m_json ? ", \"rays_per_s\": " : ",");
+  if (rays >= 0.0) out << rays; else out << none;
+  out << (m_json ? "}" : "\n");
+  output(out.str());
+  m_rows++;
+}
+
+// Grava os quadros restantes (o Renderer já esperou as consultas) e
+// mostra o resumo.
+void FrameStats::finish() {
+  if (!m_enabled)
+    return;
+  flush(true);
+  std::chrono::duration<double> wall = Clock::now() - m_start;
+  double gpuMs[STAGES];
+  for (int i = 0; i < STAGES; ++i)
+    gpuMs[i] = m_measured[i] ? m_gpuMs[i] / m_measured[i] : 0.0;
+  double rays = (m_gpuMs[TRACE] > 0.0) ? m_timedWork / (m_gpuMs[TRACE] * 1e-3) : 0.0;
+  double samples = rays / (double(m_width) * m_height);
+  double cpuMs = m_rows ? m_cpuMs / m_rows : 0.0;
+
+  if (m_json) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4);
+    out << "\n  ],\n  \"summary\": {\"frames\": " << m_rows << ", \"wall_s\": " << wall.count()
+        << ", \"rays\": " << (long long) m_work << ", \"cpu_ms\": " << cpuMs;
+    for (int i = 0; i < STAGES; ++i) {
+      out << ", \"" << STAGE_NAMES[i] << "_ms\": ";
+      if (m_measured[i]) out << gpuMs[i]; else out << "null";
+    }
+    out << ", \"samples_per_s\": " << samples << ", \"rays_per_s\": " << rays << "}\n}\n";
+    output(out.str());
+  }
+  if (m_file.is_open())
+    m_file.close();
+
+  // Com "-", o resumo fica no stderr, junto das demais mensagens.
+  std::ostream& summary = (m_fd >= 0) ? std::cerr : std::cout;
+  summary << "Quadros: " << m_rows << std::endl
+            << "GPU por quadro (ms): traçado " << gpuMs[TRACE] << ", denoiser " << gpuMs[DENOISE]
+            << ", blit " << gpuMs[BLIT] << std::endl
+            << "CPU por quadro (ms): " << cpuMs << std::endl
+            << "Amostras/s (GPU): " << samples << std::endl
+            << "Raios de câmera/s (GPU): " << rays << std::endl;
+  m_enabled = false;
+}
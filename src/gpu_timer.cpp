@@ -0,0 +1,52 @@
+#include "gpu_timer.hpp"
+
+void GpuTimer::init(int size) {
+  m_queries.resize(size);
+  m_work.resize(size);
+  m_tags.resize(size);
+  glGenQueries(size, &m_queries[0]);
+  m_head = m_tail = 0;
+}
+
+// Retorna falso se todas as consultas ainda estiverem pendentes; nesse caso
+// o passo não é medido e end() não deve ser chamado.
+bool GpuTimer::begin(double work, unsigned int tag) {
+  if (m_queries.empty() || m_head - m_tail == m_queries.size())
+    return false;
+  unsigned int i = m_head % m_queries.size();
+  m_work[i] = work;
+  m_tags[i] = tag;
+  glBeginQuery(GL_TIME_ELAPSED, m_queries[i]);
+  return true;
+}
+
+void GpuTimer::end() {
+  glEndQuery(GL_TIME_ELAPSED);
+  m_head++;
+}
+
+bool GpuTimer::poll(double& ms, double& work, unsigned int& tag) {
+  if (m_head == m_tail)
+    return false;
+
+  unsigned int i = m_tail % m_queries.size();
+  GLint available = 0;
+  glGetQueryObjectiv(m_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return false;
+
+  GLuint64 elapsed;
+  glGetQueryObjectui64v(m_queries[i], GL_QUERY_RESULT, &elapsed);
+  ms = elapsed * 1e-6;
+  work = m_work[i];
+  tag = m_tags[i];
+  m_tail++;
+  return true;
+}
+
+void GpuTimer::destroy() {
+  if (!m_queries.empty())
+    glDeleteQueries(m_queries.size(), &m_queries[0]);
+  m_queries.clear();
+  m_head = m_tail = 0;
+}
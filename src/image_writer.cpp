@@ -0,0 +1,266 @@
+#include "image_writer.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <memory>
+
+static std::string extension(const std::string& path) {
+  size_t dot = path.rfind('.');
+  if (dot == std::string::npos)
+    return "";
+  std::string ext = path.substr(dot + 1);
+  for (size_t i = 0; i < ext.size(); ++i)
+    ext[i] = tolower(ext[i]);
+  return ext;
+}
+
+bool ImageWriter::supported(const std::string& path) {
+  std::string ext = extension(path);
+  return ext == "pfm" || ext == "hdr" || ext == "exr" || ext == "ppm";
+}
+
+void ImageWriter::write(const std::vector<float>& rgb, int width, int height) {
+  if (rgb.size() != 3 * size_t(width) * size_t(height))
+    throw std::runtime_error("ERRO INTERNO: imagem com tamanho inconsistente!");
+
+  std::string ext = extension(m_path);
+  if (ext == "pfm")
+    writePFM(rgb, width, height);
+  else if (ext == "hdr")
+    writeHDR(rgb, width, height);
+  else if (ext == "exr")
+    writeEXR(rgb, width, height);
+  else if (ext == "ppm")
+    writePPM(rgb, width, height);
+  else
+    throw std::runtime_error("Formato de imagem desconhecido: " + m_path);
+}
+
+static std::ofstream openOutput(const std::string& path) {
+  std::ofstream output(path.c_str(), std::ios::binary);
+  if (!output.is_open())
+    throw std::runtime_error("Não foi possível criar o arquivo " + path);
+  return output;
+}
+
+static void checkOutput(const std::ofstream& output, const std::string& path) {
+  if (!output)
+    throw std::runtime_error("Erro durante a escrita do arquivo " + path);
+}
+
+// Portable Float Map: escala negativa indica little endian e as linhas já
+// vão de baixo para cima, como na OpenGL.
+void ImageWriter::writePFM(const std::vector<float>& rgb, int width, int height) {
+  std::ofstream output = openOutput(m_path);
+  uint16_t probe = 1;
+  bool little = *reinterpret_cast<unsigned char*>(&probe) == 1;
+  output << "PF\n" << width << " " << height << "\n" << (little ? "-1.0" : "1.0") << "\n";
+  output.write(reinterpret_cast<const char*>(&rgb[0]), rgb.size() * sizeof(float));
+  checkOutput(output, m_path);
+}
+
+// Radiance RGBE sem compressão, de cima para baixo.
+void ImageWriter::writeHDR(const std::vector<float>& rgb, int width, int height) {
+  std::ofstream output = openOutput(m_path);
+  output << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+
+  std::vector<unsigned char> line(4 * width);
+  for (int y = height - 1; y >= 0; --y) {
+    for (int x = 0; x < width; ++x) {
+      const float *c = &rgb[3 * (y * width + x)];
+      float m = std::max(c[0], std::max(c[1], c[2]));
+      unsigned char *e = &line[4 * x];
+      if (m < 1e-32f) {
+        e[0] = e[1] = e[2] = e[3] = 0;
+      } else {
+        int exponent;
+        float scale = std::frexp(m, &exponent) * 256.0f / m;
+        e[0] = (unsigned char) (std::max(0.0f, c[0]) * scale);
+        e[1] = (unsigned char) (std::max(0.0f, c[1]) * scale);
+        e[2] = (unsigned char) (std::max(0.0f, c[2]) * scale);
+        e[3] = (unsigned char) (exponent + 128);
+      }
+    }
+    output.write(reinterpret_cast<const char*>(&line[0]), line.size());
+  }
+  checkOutput(output, m_path);
+}
+
+// OpenEXR escalar, sem compressão, canais B, G e R em float 32 bits. Todos
+// os campos são little endian.
+template <typename T>
+static void put(std::string& s, T value) {
+  unsigned char bytes[sizeof(T)];
+  memcpy(bytes, &value, sizeof(T));
+  uint16_t probe = 1;
+  if (*reinterpret_cast<unsigned char*>(&probe) != 1)
+    std::reverse(bytes, bytes + sizeof(T));
+  s.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+}
+
+static void attribute(std::string& header, const std::string& name,
+                      const std::string& type, const std::string& value) {
+  header += name; header += '\0';
+  header += type; header += '\0';
+  put<int32_t>(header, value.size());
+  header += value;
+}
+
+void ImageWriter::writeEXR(const std::vector<float>& rgb, int width, int height) {
+  std::string header, value;
+  put<int32_t>(header, 20000630);  // número mágico
+  put<int32_t>(header, 2);         // versão 2, imagem escalar
+
+  const char *channels[] = {"B", "G", "R"};  // ordem alfabética
+  for (int c = 0; c < 3; ++c) {
+    value += channels[c]; value += '\0';
+    put<int32_t>(value, 2);                 // FLOAT
+    put<uint8_t>(value, 0);                 // pLinear
+    value.append(3, '\0');                  // reservado
+    put<int32_t>(value, 1); put<int32_t>(value, 1); // amostragem
+  }
+  value += '\0';
+  attribute(header, "channels", "chlist", value);
+
+  attribute(header, "compression", "compression", std::string(1, '\0'));
+
+  value.clear();
+  put<int32_t>(value, 0); put<int32_t>(value, 0);
+  put<int32_t>(value, width - 1); put<int32_t>(value, height - 1);
+  attribute(header, "dataWindow", "box2i", value);
+  attribute(header, "displayWindow", "box2i", value);
+
+  attribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+
+  value.clear(); put<float>(value, 1.0f);
+  attribute(header, "pixelAspectRatio", "float", value);
+
+  value.clear(); put<float>(value, 0.0f); put<float>(value, 0.0f);
+  attribute(header, "screenWindowCenter", "v2f", value);
+
+  value.clear(); put<float>(value, 1.0f);
+  attribute(header, "screenWindowWidth", "float", value);
+  header += '\0';
+
+  // Tabela de offsets: uma entrada por linha.
+  uint64_t lineSize = 8 + 3 * 4 * uint64_t(width);
+  uint64_t offset = header.size() + 8 * uint64_t(height);
+  for (int y = 0; y < height; ++y)
+    put<uint64_t>(header, offset + y * lineSize);
+
+  std::ofstream output = openOutput(m_path);
+  output.write(header.data(), header.size());
+
+  std::string line;
+  for (int y = 0; y < height; ++y) {
+    line.clear();
+    put<int32_t>(line, y);
+    put<int32_t>(line, 3 * 4 * width);
+    const float *row = &rgb[3 * (height - 1 - y) * width];
+    for (int c = 2; c >= 0; --c)
+      for (int x = 0; x < width; ++x)
+        put<float>(line, row[3 * x + c]);
+    output.write(line.data(), line.size());
+  }
+  checkOutput(output, m_path);
+}
+
+// PPM de 8 bits com o tonemapping da janela.
+void ImageWriter::writePPM(const std::vector<float>& rgb, int width, int height) {
+  std::ofstream output = openOutput(m_path);
+  output << "P6\n" << width << " " << height << "\n255\n";
+
+  std::vector<unsigned char> line(3 * width);
+  for (int y = height - 1; y >= 0; --y) {
+    for (int x = 0; x < width; ++x) {
+      const float *c = &rgb[3 * (y * width + x)];
+      vec3 col = tonemap(vec3(c[0], c[1], c[2]));
+      for (int k = 0; k < 3; ++k)
+        line[3 * x + k] = (unsigned char) (clamp(col[k], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+    output.write(reinterpret_cast<const char*>(&line[0]), line.size());
+  }
+  checkOutput(output, m_path);
+}
+
+// Referência http://filmicgames.com/archives/75
+static vec3 uncharted2(vec3 x) {
+  const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+  return (x*(A*x + C*B) + D*E) / (x*(A*x + B) + D*F) - E/F;
+}
+
+vec3 tonemap(vec3 color) {
+  const float W = 11.2f;
+  vec3 col = uncharted2(4.0f * color) / uncharted2(vec3(W));
+  return pow(max(col, 0.0f), vec3(1.0f / 2.2f));
+}
+
+// ====================== ESCRITA ASSÍNCRONA ======================
+// A imagem é movida para a fila; rgb fica vazio após a chamada.
+void AsyncImageWriter::push(const std::string& path, std::vector<float>& rgb,
+                            int width, int height) {
+  std::shared_ptr<std::vector<float> > image(new std::vector<float>());
+  image->swap(rgb);
+  push([path, image, width, height]() {
+    ImageWriter writer(path);
+    writer.write(*image, width, height);
+  });
+}
+
+void AsyncImageWriter::push(const std::function<void()>& job) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_thread.joinable()) {
+    m_done = false;
+    m_thread = std::thread(&AsyncImageWriter::run, this);
+  }
+  m_jobs.push_back(job);
+  m_cond.notify_one();
+}
+
+// Espera as escritas pendentes terminarem e encerra a thread.
+void AsyncImageWriter::finish() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_thread.joinable())
+      return;
+    m_done = true;
+    m_cond.notify_one();
+  }
+  m_thread.join();
+}
+
+void AsyncImageWriter::run() {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]() {return m_done || !m_jobs.empty();});
+      if (m_jobs.empty())
+        return;
+      job.swap(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    try {
+      job();
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+}
+
+std::string snapshotPath(const std::string& path, unsigned int samples) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "_%06u", samples);
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + suffix;
+  return path.substr(0, dot) + suffix + path.substr(dot);
+}
@@ -1,18 +1,219 @@
 #include "renderer.hpp"
+#include "cpu_renderer.hpp"
 #include "parser.hpp"
+#include "shader_generator.hpp"
+#include "image_writer.hpp"
+#include "checkpoint.hpp"
+#include "denoiser.hpp"
+#include "distance_field.hpp"
 
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+// Com amostragem adaptativa, a CPU reavalia a convergência a cada lote.
+#define ADAPTIVE_BATCH 16u
+
+// Lê o checkpoint a retomar e confere se ele pertence a esta renderização.
+static Checkpoint loadCheckpoint(const std::string& path, int backend, unsigned long long hash,
+                                 int width, int height) {
+  Checkpoint checkpoint;
+  checkpoint.load(path);
+  if (checkpoint.backend != backend)
+    throw std::runtime_error("O checkpoint " + path + " foi gerado pelo outro backend (--cpu)!");
+  if (checkpoint.sceneHash != hash)
+    throw std::runtime_error("O checkpoint " + path + " foi gerado a partir de outra cena!");
+  if (checkpoint.width != (unsigned) width || checkpoint.height != (unsigned) height)
+    throw std::runtime_error("O checkpoint " + path + " tem tamanho diferente da imagem!");
+  std::cout << "Retomando a partir de " << checkpoint.samples << " amostras." << std::endl;
+  return checkpoint;
+}
+
+// Resume o campo de distância pré-calculado (--bake).
+static void reportField(const DistanceField& field, double seconds) {
+  const int *cells = field.cells();
+  std::cout << "Campo de distância: " << cells[0] << "x" << cells[1] << "x" << cells[2]
+            << " células, " << field.brickCount() << " blocos finos, "
+            << field.bytes() / (1024.0 * 1024.0) << " MB em " << seconds << " s" << std::endl;
+}
+
+static int renderCPU(const std::string& scene, int width, int height, int threads, int spp,
+                     const std::string& out, int snapshot,
+                     const std::string& checkpointPath, int checkpointEvery, bool resume,
+                     float adaptive, int adaptiveMin, bool denoised, int bake) {
+  try {
+    Parser parser(scene);
+    parser.read();
+    CpuRenderer renderer(parser.getScene(), width, height, threads);
+    renderer.setAdaptive(adaptive, adaptiveMin);
+    if (bake > 0) {
+      auto start = std::chrono::steady_clock::now();
+      renderer.bakeField(bake);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      reportField(renderer.getField(), elapsed.count());
+    }
+
+    unsigned long long hash = 0;
+    if (!checkpointPath.empty()) {
+      hash = sceneHash(scene);
+      if (resume) {
+        Checkpoint checkpoint = loadCheckpoint(checkpointPath, Checkpoint::CPU, hash, width, height);
+        renderer.resume(checkpoint.data, checkpoint.moments, checkpoint.samples);
+      }
+    }
+
+    std::cout << "Renderizando na CPU com " << renderer.getThreads()
+              << " threads..." << std::endl;
+    // Com imagens parciais ou checkpoints, renderiza em lotes e grava cada
+    // lote em paralelo. O checkpoint da CPU guarda a soma das amostras.
+    AsyncImageWriter snapshots;
+    auto saveCheckpoint = [&]() {
+      std::shared_ptr<Checkpoint> checkpoint(new Checkpoint);
+      checkpoint->backend = Checkpoint::CPU;
+      checkpoint->width = width;
+      checkpoint->height = height;
+      checkpoint->samples = renderer.getSamples();
+      checkpoint->sceneHash = hash;
+      checkpoint->data = renderer.getSum();
+      checkpoint->moments = renderer.getMoments();
+      std::string path = checkpointPath;
+      snapshots.push([checkpoint, path]() {checkpoint->save(path);});
+    };
+    unsigned int first = renderer.getSamples();
+    auto start = std::chrono::steady_clock::now();
+    while (renderer.getSamples() < (unsigned) spp && !renderer.converged()) {
+      unsigned int count = spp - renderer.getSamples();
+      if (adaptive > 0)
+        count = std::min(count, ADAPTIVE_BATCH - renderer.getSamples() % ADAPTIVE_BATCH);
+      if (snapshot > 0)
+        count = std::min(count, snapshot - renderer.getSamples() % snapshot);
+      if (!checkpointPath.empty())
+        count = std::min(count, checkpointEvery - renderer.getSamples() % checkpointEvery);
+      renderer.render(count);
+      if (snapshot > 0 && renderer.getSamples() % snapshot == 0) {
+        std::vector<float> image = renderer.getImage();
+        snapshots.push(snapshotPath(out, renderer.getSamples()), image, width, height);
+      }
+      if (!checkpointPath.empty() &&
+          (renderer.getSamples() % checkpointEvery == 0 || renderer.getSamples() == (unsigned) spp ||
+           renderer.converged()))
+        saveCheckpoint();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    snapshots.finish();
+
+    if (renderer.converged())
+      std::cout << "Todos os pixels convergiram." << std::endl;
+    std::cout << "Amostras: " << renderer.getSamples() << std::endl
+              << "Finalizado!" << std::endl
+              << "Tempo: " << elapsed.count() << std::endl
+              << "Amostras/s: " << (renderer.getSamples() - first) / elapsed.count() << std::endl;
+
+    if (!out.empty()) {
+      std::vector<float> image = renderer.getImage();
+      if (denoised) {
+        std::vector<float> moments, albedo, normal;
+        renderer.getAuxiliary(moments, albedo, normal);
+        image = denoise(image, moments, albedo, normal, width, height);
+      }
+      ImageWriter writer(out);
+      writer.write(image, width, height);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[])
 {
   float time = -1;
+  bool cpu = false, headless = false, cache = true, resume = false, denoised = false;
+  int threads = 0, spp = 16, sppPass = 0, tile = 256, snapshot = 0, checkpointEvery = 256;
+  int adaptiveMin = 32, bake = 0;
+  float frameTime = 16.0f, adaptive = 0.0f;
+  std::string out, checkpoint, stats;
   
+  // Separa as opções (--xxx) dos parâmetros posicionais.
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (!strcmp(argv[i], "--cpu"))
+      cpu = true;
+    else if (!strcmp(argv[i], "--headless"))
+      headless = true;
+    else if (!strcmp(argv[i], "--threads") && i+1 < argc)
+      threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--spp") && i+1 < argc)
+      spp = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--spp-pass") && i+1 < argc)
+      sppPass = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--frame-ms") && i+1 < argc)
+      frameTime = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--tile") && i+1 < argc)
+      tile = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--no-cache"))
+      cache = false;
+    else if (!strcmp(argv[i], "--out") && i+1 < argc)
+      out = argv[++i];
+    else if (!strcmp(argv[i], "--snapshot") && i+1 < argc)
+      snapshot = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--checkpoint") && i+1 < argc)
+      checkpoint = argv[++i];
+    else if (!strcmp(argv[i], "--checkpoint-every") && i+1 < argc)
+      checkpointEvery = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--resume"))
+      resume = true;
+    else if (!strcmp(argv[i], "--adaptive") && i+1 < argc)
+      adaptive = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--adaptive-min") && i+1 < argc)
+      adaptiveMin = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--denoise"))
+      denoised = true;
+    else if (!strcmp(argv[i], "--stats") && i+1 < argc)
+      stats = argv[++i];
+    else if (!strcmp(argv[i], "--bake") && i+1 < argc)
+      bake = atoi(argv[++i]);
+    else
+      args.push_back(argv[i]);
+  }
+  argc = args.size();
+  argv = &args[0];
+
   // Linux/Mac only...
   if (argc <= 1) {
     std::cout << argv[0] << " [entrada] [largura] [altura] [tempo]" << std::endl
               << "Os parâmetros [largura], [altura] e [tempo] são opcionais." << std::endl << std::endl
+              << "Opções:" << std::endl
+              << "  --cpu          renderiza na CPU, sem janela" << std::endl
+              << "  --headless     renderiza na GPU sem janela (EGL), sem vsync" << std::endl
+              << "  --threads N    número de threads da CPU (padrão: todos os núcleos)" << std::endl
+              << "  --spp N        amostras por pixel nos modos sem janela (padrão: 16)" << std::endl
+              << "  --spp-pass N   amostras por passo na GPU (padrão: 0, automático)" << std::endl
+              << "  --frame-ms T   tempo de GPU desejado por envio (padrão: 16)" << std::endl
+              << "  --tile S       lado dos blocos em que a imagem é dividida (padrão: 256)" << std::endl
+              << "  --no-cache     não usa o cache de shaders compilados (~/.cache/frag-pathtracer)" << std::endl
+              << "  --out ARQUIVO  grava a imagem ao final (.pfm, .hdr, .exr ou .ppm com tonemapping);" << std::endl
+              << "                 sem --cpu, implica --headless" << std::endl
+              << "  --snapshot K   com --out, grava também a imagem a cada K amostras" << std::endl
+              << "                 (ex.: saida_000256.exr), sem interromper a renderização" << std::endl
+              << "  --checkpoint ARQUIVO  salva periodicamente o estado da renderização" << std::endl
+              << "  --checkpoint-every K  intervalo (em amostras) entre checkpoints (padrão: 256)" << std::endl
+              << "  --resume       continua a partir do --checkpoint até --spp amostras" << std::endl
+              << "  --adaptive E   para de amostrar os pixels com erro relativo abaixo de E" << std::endl
+              << "                 (ex.: 0.02) e termina quando todos convergirem" << std::endl
+              << "  --adaptive-min N  amostras antes de estimar o erro de um pixel (padrão: 32)" << std::endl
+              << "  --denoise      filtra a imagem exibida e a gravada em --out (à-trous guiado" << std::endl
+              << "                 por albedo, normal e profundidade)" << std::endl
+              << "  --stats ARQUIVO  grava tempos de GPU e CPU e vazão de cada quadro (.csv ou" << std::endl
+              << "                 .json; \"-\" escreve o CSV na saída padrão), só na GPU" << std::endl
+              << "  --bake N       pré-calcula o map() em um campo de distância esparso com N" << std::endl
+              << "                 células no maior eixo (ex.: 64); a marcha só avalia a cena" << std::endl
+              << "                 exata perto das superfícies" << std::endl << std::endl
               << "ATENÇÃO: a sintaxe original dos arquivos de entrada foi alterada!!!" 
               << std::endl << "Utilize os arquivos no diretório scenes como entrada!!!" << std::endl;
     return EXIT_SUCCESS;
@@ -32,21 +233,102 @@ int main(int argc, char *argv[])
     } 
   }
 
+  if (spp <= 0 || sppPass < 0 || frameTime <= 0 || tile <= 0) {
+    std::cout << "O número de amostras, o tempo por envio e os blocos precisam ser positivos!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!out.empty() && !ImageWriter::supported(out)) {
+    std::cout << "Formato de saída desconhecido: " << out << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (snapshot < 0 || (snapshot > 0 && out.empty())) {
+    std::cout << "--snapshot precisa de um intervalo positivo e de --out!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (checkpointEvery <= 0 || (resume && checkpoint.empty())) {
+    std::cout << "--checkpoint-every precisa ser positivo e --resume precisa de --checkpoint!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (adaptive < 0 || adaptiveMin < 2) {
+    std::cout << "--adaptive não pode ser negativo e --adaptive-min precisa ser ao menos 2!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (bake < 0) {
+    std::cout << "--bake precisa de uma resolução positiva!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (cpu && !stats.empty()) {
+    std::cout << "--stats mede as consultas de tempo da GPU e não funciona com --cpu!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (cpu)
+    return renderCPU(argv[1], width, height, threads, spp, out, snapshot,
+                     checkpoint, checkpointEvery, resume, adaptive, adaptiveMin, denoised, bake);
+
+  // A saída em arquivo é sempre uma renderização offline.
+  if (!out.empty())
+    headless = true;
+
+  // O CSV de --stats - ocupa a saída padrão desde as primeiras mensagens.
+  if (stats == "-")
+    FrameStats::reserveStdout();
+
   Renderer renderer(time);
+  renderer.setSamplesPerPass(sppPass);
+  renderer.setFrameTime(frameTime);
+  renderer.setTileSize(tile);
+  renderer.setProgramCache(cache);
+  renderer.setSnapshots(snapshot, out);
+  renderer.setAdaptive(adaptive, adaptiveMin);
+  renderer.setDenoise(denoised);
   try {
-    renderer.setupWindow(width, height);
+    if (headless) {
+      renderer.setupHeadless(width, height);
+      renderer.setSamples(spp);
+    } else {
+      renderer.setupWindow(width, height);
+    }
+    if (!stats.empty())
+      renderer.setStats(stats);
+
+    if (!checkpoint.empty()) {
+      unsigned long long hash = sceneHash(argv[1]);
+      renderer.setCheckpoint(checkpointEvery, checkpoint, hash);
+      if (resume)
+        renderer.resume(loadCheckpoint(checkpoint, Checkpoint::GPU, hash, width, height));
+    }
 
     Parser parser(argv[1]);
+    parser.read();
+    ShaderGenerator generator(parser.getScene(), bake > 0);
     ShaderReader blitReader("shaders/blit.glsl");
+    ShaderReader convergeReader("shaders/converge.glsl");
+    ShaderReader denoiseReader("shaders/denoise.glsl");
     ShaderReader vertexReader("shaders/vertex.glsl");
     ShaderReader templateReader("shaders/template.glsl");
 
     std::string blitShader = blitReader.read();
+    std::string convergeShader = convergeReader.read();
+    std::string denoiseShader = denoiseReader.read();
     std::string vertexShader = vertexReader.read();
-    std::string raytracerShader = templateReader.read() + parser.read();
+    std::string raytracerShader = templateReader.read() + generator.generate();
 
-    renderer.setLights(parser.getLights());
-    renderer.setupProgram(vertexShader, raytracerShader, blitShader);
+    renderer.setupProgram(vertexShader, raytracerShader, blitShader, convergeShader, denoiseShader);
+    renderer.uploadScene(parser.getScene());
+    if (bake > 0) {
+      DistanceField field;
+      auto start = std::chrono::steady_clock::now();
+      renderer.bakeField(field, parser.getScene(), bake, vertexShader, raytracerShader);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      reportField(field, elapsed.count());
+    }
     
     TextureLoader texLoader;
     texLoader.load(parser.getTextures());    
@@ -66,6 +348,22 @@ int main(int argc, char *argv[])
   }
   
   renderer.render();
+  if (!out.empty()) {
+    try {
+      std::vector<float> image = renderer.readImage();
+      if (denoised) {
+        std::vector<float> moments, albedo, normal;
+        renderer.readAuxiliary(moments, albedo, normal);
+        image = denoise(image, moments, albedo, normal, width, height);
+      }
+      ImageWriter writer(out);
+      writer.write(image, width, height);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      renderer.terminate();
+      return EXIT_FAILURE;
+    }
+  }
   renderer.terminate();
   return EXIT_SUCCESS;
 }
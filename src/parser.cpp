@@ -1,5 +1,6 @@
 #include "parser.hpp"
 #include "renderer.hpp"
+#include "tokenizer.hpp"
 
 #include <fstream>
 #include <sstream>
@@ -11,277 +12,241 @@
 #include <stdlib.h>
 #include <cmath>
 
-// Não verifica por erros no arquivo de cena...
-std::string Parser::read() {
-  std::ifstream input(m_file.c_str());
-
-  if (!input.is_open())
-    throw std::runtime_error("Arquivo não encontrado: " + m_file);
-
-  // LEITURA DO ARQUIVO DE ENTRADA
-  std::string camera = readCamera(input);
-  std::string lights = readLights(input);
-  std::string materials = readMaterials(input);
-  std::string properties = readProperties(input);
-  
-  std::string objects, select;
-  readObjects(input, objects, select, lights);
-
-  // MONTAGEM DAS FUNCOES DO SHADER
-  std::stringstream map;
-  map << "float map(vec3 p) {" << std::endl
-      << "float d = FAR;" << std::endl
-      << objects << std::endl << "return d;"
-      << std::endl << "}" << std::endl;
-
-  std::stringstream selectMaterial;
-  selectMaterial << "ivec3 selectMaterial(vec3 p) {" << std::endl
-                 << "float d = FAR, aux; ivec3 mat = ivec3(0);"
-                 << std::endl << select << std::endl
-                 << "return mat;" << std::endl << "}" << std::endl;
-
-  std::stringstream build;
-  build << "void buildMaterialsAndLights() {" << std::endl
-        << materials << properties << lights << std::endl
-        << "}" << std::endl;
-  return camera + externalObjects.str() + map.str() +
-    selectMaterial.str() + build.str();
+// Os erros de sintaxe e as referências inválidas são reportados com a
+// linha e a coluna do token (ver Tokenizer).
+void Parser::read() {
+  Tokenizer input(m_file);
+
+  // O código do shader é gerado depois, a partir de m_scene
+  // (ver ShaderGenerator).
+  readCamera(input);
+  readLights(input);
+  readMaterials(input);
+  readProperties(input);
+  readObjects(input);
+  if (!input.atEnd())
+    input.error(input.word(), "conteúdo após o último objeto");
 }
 
-std::string Parser::readCamera(std::ifstream& input)
+void Parser::readCamera(Tokenizer& input)
 {
-  std::string camx, camy, camz;
-  std::string projx, projy, projz;
-  std::string upx, upy, upz;
-  std::string fov;
-  std::stringstream camera;
-  
-  input >> camx >> camy >> camz
-        >> projx >> projy >> projz
-        >> upx >> upy >> upz >> fov;
-  
-  camera << "void buildCamera(out vec3 ro, out vec3 rd) {" << std::endl
-         << "ro = vec3(" << camx << "," << camy << "," << camz << ");"
-        //<< "ro += 0.05*(2.0*vec3(rand(), rand(), rand()) - 1.0);" // hacky DOF
-         << std::endl << "vec3 t = vec3(" << projx << "," << projy
-         << "," << projz << ")," << "n = vec3(" << upx << "," << upy
-         << "," << upz << ");" << std::endl
-         << "vec3 f = normalize(ro - t);" << std::endl
-         << "vec3 r = normalize(cross(normalize(n), f));" << std::endl
-         << "vec3 u = normalize(cross(f, r));" << std::endl
-         << "vec2 uv = (-iResolution.xy+2.0*gl_FragCoord.xy)/iResolution.y;" << std::endl
-         << "uv += 0.0055*(2.0*vec2(rand(), rand()) - 1.0);" << std::endl
-         << "uv *= tan(0.5*" << fov << "*3.141592/180);" << std::endl
-         << "rd = normalize(mat3(r,u,f)*vec3(uv, -1.0));" << std::endl
-         << std::endl << "}" << std::endl;
-  return camera.str();
+  SceneCamera& cam = m_scene.camera;
+  cam.position = readVec3(input);
+  cam.target = readVec3(input);
+  cam.up = readVec3(input);
+  cam.fov = input.number();
 }
 
-std::string Parser::readLights(std::ifstream& input) {
-  int nLights;
-  std::stringstream lights;
-
-  input >> nLights; m_lights = nLights;
+void Parser::readLights(Tokenizer& input) {
+  int nLights = readCount(input);
   for (int i = 0; i < nLights; ++i) {
-    std::string px, py, pz;
-    std::string r, g, b;
-
-    input >> px >> py >> pz >> r >> g >> b;
-    lights << "lights["<<i<<"] = Light(0, vec3(" << px << "," << py << ","
-           << pz << "),vec3(" << r << "," << g << "," << b << "),0);"
-           << std::endl;
+    SceneLight light;
+    light.type = 0; light.radius = 0;
+    light.position = readVec3(input);
+    light.color = readVec3(input);
+    m_scene.lights.push_back(light);
   }
-  return lights.str();
 }
 
-std::string Parser::readMaterials(std::ifstream& input) {
-  int nMaterials;
-  std::stringstream materials;
-
+void Parser::readMaterials(Tokenizer& input) {
+  // Cada tipo de material tem seu próprio array no shader; as texturas
+  // começam no iChannel[2].
   int colIndex = 0, checkIndex = 0, texIndex = 2;
-  input >> nMaterials;
+  int nMaterials = readCount(input);
   for (int i = 0; i < nMaterials; ++i) {
-    std::string type;
+    SceneMaterial material;
+    material.size = 0;
 
-    input >> type;
+    Token type = input.word();
     if (type == "solid") {
-      std::string r, g, b;
-      typeHash[i] = 0;
-      colorHash[i] = colIndex++;
-      input >> r >> g >> b;
-      materials << "solidColors["<< colorHash[i] << "] = vec3("
-                << r << "," << g << "," << b << ");" << std::endl;
+      material.type = 0; material.index = colIndex++;
+      material.colorA = readVec3(input);
       
     } else if (type == "checker") {
-      std::string r[2], g[2], b[2], size;
-      typeHash[i] = 1;
-      checkerHash[i] = checkIndex++;
-      input >> r[0] >> g[0] >> b[0] >> r[1] >> g[1] >> b[1] >> size;
-      materials << "checkerColorA["<< checkerHash[i] << "] = vec3("
-                << r[0] << "," << g[0] << "," << b[0] << ");" << std::endl;
-      materials << "checkerColorB["<< checkerHash[i] << "] = vec3("
-                << r[1] << "," << g[1] << "," << b[1] << ");" << std::endl;
-      materials << "checkerSize["<< checkerHash[i] << "] = " << size << ";" << std::endl;
+      material.type = 1; material.index = checkIndex++;
+      material.colorA = readVec3(input);
+      material.colorB = readVec3(input);
+      material.size = input.number();
       
     } else if (type == "texmap") {
-      std::string name, scale;
-      typeHash[i] = 2;
-      texHash[i] = texIndex++;
-      input >> name >> scale;
-      materials << "textureScale[" << texHash[i] << "] = " << scale << ";" << std::endl;
+      std::string name = input.word().str();
+      material.type = 2; material.index = texIndex++;
+      material.size = input.number();
+      material.texture = m_root_dir + name;
       m_textures.push_back(m_root_dir + name);
-    }
-      
-  }
-  return materials.str();
-}
-
-std::string Parser::readProperties(std::ifstream& input) {
-  int nProperties;
-  std::stringstream properties;
 
-  input >> nProperties;
-  for (int i = 0; i < nProperties; ++i) {
-    float er, eg, eb, alpha;
-    float kr, kt, ior;
-    input >> er >> eg >> eb >> alpha >> kr >> kt >> ior;
-    properties << "properties[" << i << "] = Properties(vec3("
-               << er << "," << eg << "," << eb << ")," << alpha << ","
-               << kr << "," << kt << "," << ior << ");" << std::endl;
-    if (er > 0 || eg > 0 || eb > 0) {
-      isLight[i] = true;
-      lightColor[i] = std::make_tuple(er, eg, eb);
+    } else {
+      input.error(type, "tipo de material desconhecido: " + type.str());
     }
+    m_scene.materials.push_back(material);
   }
-
-  return properties.str();
 }
 
-void Parser::writeMaterial(std::stringstream& ss, int id1, int id2) {
-  ss << "if (aux < d) {d = aux; mat = ivec3(" << typeHash[id1];
-  switch(typeHash[id1]) {
-    case 0:
-      ss << "," << colorHash[id1]; break;
-    case 1:
-      ss << "," << checkerHash[id1]; break;
-    case 2:
-      ss << "," << texHash[id1]; break;
+void Parser::readProperties(Tokenizer& input) {
+  int nProperties = readCount(input);
+  for (int i = 0; i < nProperties; ++i) {
+    SceneProperties prop;
+    prop.emission = readVec3(input);
+    prop.alpha = input.number();
+    prop.kr = input.number();
+    prop.kt = input.number();
+    prop.ior = input.number();
+    m_scene.properties.push_back(prop);
   }
-  ss << "," << id2 << ");}" << std::endl;
 }
 
-void Parser::readObjects(std::ifstream& input, std::string& objects, std::string& materialSelection, std::string& lights) {
-  int nObjects;
-  std::stringstream map, select, lightStream;
-  
-  input >> nObjects;
+void Parser::readObjects(Tokenizer& input) {
+  int nObjects = readCount(input);
+  m_scene.objects.reserve(nObjects);
   for (int i = 0; i < nObjects; ++i) {
-    int property, material;
-    std::string type;
-  
-    input >> material >> property >> type;
-    if (isLight[property] && type != "sphere" )
-      throw std::runtime_error("Apenas esferas podem ser emissivas!");
-    
+    Token materialToken, propertyToken;
+    int material = input.integer(&materialToken);
+    int property = input.integer(&propertyToken);
+    Token type = input.word();
+    if (material < 0 || material >= (int) m_scene.materials.size())
+      input.error(materialToken, "material inexistente no objeto " + type.str());
+    if (property < 0 || property >= (int) m_scene.properties.size())
+      input.error(propertyToken, "propriedade inexistente no objeto " + type.str());
+
+    const vec3& emission = m_scene.properties[property].emission;
+    bool isLight = emission.x > 0 || emission.y > 0 || emission.z > 0;
+    if (isLight && type != "sphere")
+      input.error(type, "apenas esferas podem ser emissivas");
+
+    ScenePrimitive object;
+    object.material = material;
+    object.property = property;
     if (type == "sphere") {
-      std::string x, y, z, r;
-      input  >> x >> y >> z >> r;
-      map << "d = min(d, sphere(p,vec4(" << x << "," << y << "," << z
-          << "," << r << ")));" << std::endl;
-      select << "aux = sphere(p,vec4(" << x << "," << y << "," << z
-             << "," << r << "));" << std::endl;
-      if (isLight[property]) {
-        auto col = lightColor[property];
-        lightStream << "lights["<<m_lights++<<"] = Light(1, vec3(" << x << "," << y << ","
-                    << z << "),vec3(" << std::get<0>(col) << "," << std::get<1>(col) << ","
-                    << std::get<2>(col) << ")," << r <<");" << std::endl;
+      object.type = PRIMITIVE_SPHERE;
+      readParams(input, object, 4);
+      if (isLight) {
+        SceneLight light;
+        light.type = 1;
+        light.position = vec3(object.params[0], object.params[1], object.params[2]);
+        light.color = emission;
+        light.radius = object.params[3];
+        m_scene.lights.push_back(light);
       }
     } else if (type == "polyhedron") {
-      int faces;
-      input >> faces;
-      if (faces <= 0)
-        throw std::runtime_error("Poliedro sem faces!");
-      map << "d = min(d,"; select << "aux = ";
-      for (int j = 0; j+1 < faces; ++j) {
-        std::string x, y, z, w;
-        input >> x >> y >> z >> w;
-        map << "min(plane(p,vec4("<<x<<","<<y<<","<<z<<","<<w<<")),";
-        select << "min(plane(p,vec4("<<x<<","<<y<<","<<z<<","<<w<<")),";
-      }
-      std::string x, y, z, w;
-      input >> x >> y >> z >> w;
-      map << "plane(p,vec4("<<x<<","<<y<<","<<z<<","<<w<<")))";
-      select << "plane(p,vec4("<<x<<","<<y<<","<<z<<","<<w<<"))";
-      for (int j = 0; j+1 < faces; ++j) {
-        map << ")"; select << ")";
-      }
-      map << ";" << std::endl;
-      select << ";" << std::endl;
-    
+      Token faces;
+      int nFaces = input.integer(&faces);
+      if (nFaces <= 0)
+        input.error(faces, "poliedro sem faces");
+      object.type = PRIMITIVE_POLYHEDRON;
+      readParams(input, object, 4 * nFaces);
+
     } else if (type == "box") {
-      std::string x, y, z, sx, sy, sz;
-      input >> x >> y >> z >> sx >> sy >> sz;
-      map << "d = min(d, box(p,vec3(" << x << "," << y << "," << z
-          << "), vec3(" << sx << "," << sy << "," << sz << ")));" << std::endl;
-      select << "aux = box(p,vec3(" << x << "," << y << "," << z
-             << "), vec3(" << sx << "," << sy << "," << sz << "));" << std::endl;
-      
+      object.type = PRIMITIVE_BOX;
+      readParams(input, object, 6);
+
     } else if (type == "torus") {
-      std::string x, y, z, r1, r2;
-      input >> x >> y >> z >> r1 >> r2;
-      map << "d = min(d, torus(p,vec3(" << x << "," << y << "," << z
-          << "), vec2(" << r1 << "," << r2 << ")));" << std::endl;
-      select << "aux = torus(p,vec3(" << x << "," << y << "," << z
-             << "), vec2(" << r1 << "," << r2 << "));" << std::endl;
- 
+      object.type = PRIMITIVE_TORUS;
+      readParams(input, object, 5);
+
     } else if (type == "cone") {
-      std::string x, y, z, sx, sy, sz;
-      input >> x >> y >> z >> sx >> sy;
-      map << "d = min(d, cone(p,vec3(" << x << "," << y << "," << z
-          << "), vec2(" << sx << "," << sy << ")));" << std::endl;
-      select << "aux = cone(p,vec3(" << x << "," << y << "," << z
-             << "), vec2(" << sx << "," << sy << "));" << std::endl;
-      
+      object.type = PRIMITIVE_CONE;
+      readParams(input, object, 5);
+
     } else if (type == "cylinder") {
-      std::string x, y, z, r1, r2;
-      input >> x >> y >> z >> r1 >> r2;
-      map << "d = min(d, cylinder(p,vec3(" << x << "," << y << "," << z
-          << "), vec2(" << r1 << "," << r2 << ")));" << std::endl;
-      select << "aux = cylinder(p,vec3(" << x << "," << y << "," << z
-             << "), vec2(" << r1 << "," << r2 << "));" << std::endl;
+      object.type = PRIMITIVE_CYLINDER;
+      readParams(input, object, 5);
+
     } else if (type == "disk") {
-      float x, y, z, nx, ny, nz, r;
-      input >> x >> y >> z >> nx >> ny >> nz >> r;
-      float div = sqrt(nx * nx + ny*ny + nz*nz);
-      nx /= div; ny /= div; nz /= div;
-      map << "d = min(d, disk(p,vec3(" << x << "," << y << "," << z
-          << "), vec3(" << nx << "," << ny << "," << nz <<")," << r << "));" << std::endl;
-      select << "aux = disk(p,vec3(" << x << "," << y << "," << z
-             << "), vec3(" << nx << "," << ny << "," << nz <<")," << r << ");" << std::endl;
-      /*if (isLight[property]) {
-        auto col = lightColor[property];
-        lightStream << "lights["<<m_lights++<<"] = Light(1, vec3(" << x << "," << y << ","
-                    << z << "),vec3(" << std::get<0>(col) << "," << std::get<1>(col) << ","
-                    << std::get<2>(col) << ")," << "vec4("<<nx<<","<<ny<<","<<nz<<","<<r
-                    <<"));" << std::endl;
-                    }*/
-      
-    } else { // unknown type (try to load a shader for it)
-      std::string x, y, z;
-      ShaderReader reader("shaders/" + type + ".glsl");
-      input >> x >> y >> z;
-      map << "d = min(d, "+type+"(p,vec3(" << x << "," << y << "," << z
-          << ")));" << std::endl;
-      select << "aux = "+type+"(p,vec3(" << x << "," << y << "," << z
-          << "));" << std::endl;
-      externalObjects << reader.read();
+      object.type = PRIMITIVE_DISK;
+      readParams(input, object, 7);
+      float div = sqrt(object.params[3] * object.params[3] + object.params[4] * object.params[4] +
+                       object.params[5] * object.params[5]);
+      for (int j = 3; j < 6; ++j)
+        object.params[j] /= div;
+
+    } else if (type == "mesh") {
+      object.type = PRIMITIVE_MESH;
+      object.name = m_root_dir + input.word().str();
+      SceneMesh mesh;
+      mesh.object = m_scene.objects.size();
+      ObjReader(object.name).read(mesh);
+      m_scene.meshes.push_back(mesh);
+
+    } else { // unknown type (the generator loads a shader for it)
+      object.type = PRIMITIVE_CUSTOM;
+      object.name = type.str();
+      readParams(input, object, 3);
     }
-    writeMaterial(select, material, property);
+    m_scene.objects.push_back(object);
   }
+}
+
+vec3 Parser::readVec3(Tokenizer& input) {
+  float x = input.number();
+  float y = input.number();
+  float z = input.number();
+  return vec3(x, y, z);
+}
+
+int Parser::readCount(Tokenizer& input) {
+  Token token;
+  int count = input.integer(&token);
+  if (count < 0)
+    input.error(token, "contagem negativa: " + token.str());
+  return count;
+}
 
-  objects = map.str();
-  materialSelection = select.str();
-  lights += lightStream.str();
+void Parser::readParams(Tokenizer& input, ScenePrimitive& object, int count) {
+  object.params.reserve(object.params.size() + count);
+  for (int i = 0; i < count; ++i)
+    object.params.push_back(input.number());
+}
+
+// ====================== OBJ READER ======================
+// Índice de vértice de uma face ("v", "v/t", "v//n" ou "v/t/n"), a partir de
+// 1; os negativos contam a partir do último vértice lido.
+static bool objIndex(const Token& token, int vertices, int& index) {
+  const char *p = token.begin, *end = token.begin + token.size;
+  bool negative = p != end && *p == '-';
+  if (negative)
+    ++p;
+  long long value = 0;
+  const char *digits = p;
+  for (; p != end && *p >= '0' && *p <= '9' && value <= vertices; ++p)
+    value = 10 * value + (*p - '0');
+  if (p == digits || (p != end && *p != '/'))
+    return false;
+  index = negative ? vertices - int(value) : int(value) - 1;
+  return index >= 0 && index < vertices;
+}
+
+void ObjReader::read(SceneMesh& mesh) {
+  Tokenizer input(m_path);
+  while (!input.atEnd()) {
+    Token key = input.word();
+    if (key == "v") {
+      float x = input.number();
+      float y = input.number();
+      float z = input.number();
+      mesh.vertices.push_back(vec3(x, y, z));
+
+    } else if (key == "f") {
+      int vertices = mesh.vertices.size(), first = -1, previous = -1;
+      for (int j = 0; !input.atLineEnd(); ++j) {
+        Token token = input.word();
+        int index;
+        if (!objIndex(token, vertices, index))
+          input.error(token, "vértice inválido na face: " + token.str());
+        if (j >= 2) {
+          mesh.indices.push_back(first);
+          mesh.indices.push_back(previous);
+          mesh.indices.push_back(index);
+        }
+        if (j == 0)
+          first = index;
+        previous = index;
+      }
+    }
+    // Normais, coordenadas de textura, grupos, materiais e comentários.
+    input.skipLine();
+  }
+  if (mesh.indices.empty())
+    throw std::runtime_error("A malha " + m_path + " não tem triângulos!");
 }
 
 // ====================== SHADER READER ======================
@@ -303,24 +268,24 @@ std::string ShaderReader::read() {
 }
 
 // ====================== PPM READER ======================
-void TextureLoader::load(const std::string& path) {
+Image PPMReader::read() {
   char buffer[256];
-  unsigned char* image;
+  Image image;
   unsigned int width, height;
 
   FILE *fp;
-  fp = fopen(path.c_str(), "rb");
+  fp = fopen(m_path.c_str(), "rb");
   
   try {
     if (!fp)
-      throw std::runtime_error("Arquivo não encontrado: " + path);
+      throw std::runtime_error("Arquivo não encontrado: " + m_path);
 
     // Magic number
     if (!fgets(buffer, sizeof(buffer), fp))
-      throw std::runtime_error("Erro durante a leitura do arquivo " + path);
+      throw std::runtime_error("Erro durante a leitura do arquivo " + m_path);
     
     if (buffer[0] != 'P' || buffer[1] != '6')
-      throw std::runtime_error(path + "não é um arquivo PPM válido (P6)");
+      throw std::runtime_error(m_path + "não é um arquivo PPM válido (P6)");
 
     // Ignora os comentarios
     char c = getc(fp);
@@ -332,19 +297,20 @@ void TextureLoader::load(const std::string& path) {
 
     // tamanho da imagem
     if (fscanf(fp, "%u %u", &width, &height) != 2)
-      throw std::runtime_error("Erro durante a leitura do arquivo " + path);
+      throw std::runtime_error("Erro durante a leitura do arquivo " + m_path);
 
     // profundidade de cor
     unsigned int depth;
     if (fscanf(fp, "%u", &depth) != 1)
-      throw std::runtime_error("Erro durante a leitura do arquivo " + path);
+      throw std::runtime_error("Erro durante a leitura do arquivo " + m_path);
     if (depth != 255)
-      throw std::runtime_error("Profundidade de cor é diferente de 8 bpp no arquivo " + path);
+      throw std::runtime_error("Profundidade de cor é diferente de 8 bpp no arquivo " + m_path);
     while (fgetc(fp) != '\n');
 
-    image = new unsigned char[3*width*height];
-    if (fread(image, 3*width, height, fp) != height)
-      throw std::runtime_error("Erro durante a leitura do arquivo " + path);
+    image.width = width; image.height = height;
+    image.data.resize(3*width*height);
+    if (fread(&image.data[0], 3*width, height, fp) != height)
+      throw std::runtime_error("Erro durante a leitura do arquivo " + m_path);
     fclose(fp);
     
   } catch (std::runtime_error& e) {
@@ -353,20 +319,26 @@ void TextureLoader::load(const std::string& path) {
     throw e;
   }
 
+  return image;
+}
+
+void TextureLoader::load(const std::string& path) {
+  PPMReader reader(path);
+  Image image = reader.read();
+
   // Carrega a textura no OpenGL.
   GLuint tex;
   glGenTextures(1, &tex);
   glActiveTexture(GL_TEXTURE0 + this->count);
   glBindTexture(GL_TEXTURE_2D, tex);
   
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, &image.data[0]);
   glGenerateMipmap(GL_TEXTURE_2D);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  delete[] image;
 }
 
 void TextureLoader::load(const std::vector<std::string>& textures) {
@@ -0,0 +1,131 @@
+#include "program_cache.hpp"
+#include "hash.hpp"
+
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Formato de cada entrada: assinatura, formato do binário e o binário.
+static const char MAGIC[8] = {'F', 'P', 'T', 'P', 'R', 'O', 'G', '1'};
+
+
+static std::string glString(GLenum name) {
+  const GLubyte *str = glGetString(name);
+  return str ? reinterpret_cast<const char*>(str) : "";
+}
+
+ProgramCache::ProgramCache() : m_enabled(true) {
+  // Segue a especificação XDG: $XDG_CACHE_HOME ou ~/.cache.
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  std::string base;
+  if (xdg && *xdg)
+    base = xdg;
+  else if (home && *home)
+    base = std::string(home) + "/.cache";
+  else
+    return;
+
+  mkdir(base.c_str(), 0755);
+  m_dir = base + "/frag-pathtracer";
+  if (mkdir(m_dir.c_str(), 0755) != 0) {
+    struct stat st;
+    if (stat(m_dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+      m_dir.clear();
+  }
+}
+
+bool ProgramCache::isEnabled() const {
+  if (!m_enabled || m_dir.empty())
+    return false;
+
+  // Sem ARB_get_program_binary a consulta falha e deixa o valor em zero.
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  while (glGetError() != GL_NO_ERROR);
+  return formats > 0;
+}
+
+std::string ProgramCache::key(const std::string& vertex, const std::string& fragment) const {
+  unsigned long long h = fnv1a(vertex);
+  h = fnv1a(std::string(1, '\0') + fragment, h);
+  h = fnv1a(std::string(1, '\0') + glString(GL_VENDOR), h);
+  h = fnv1a(std::string(1, '\0') + glString(GL_RENDERER), h);
+  h = fnv1a(std::string(1, '\0') + glString(GL_VERSION), h);
+
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", h);
+  return hex;
+}
+
+std::string ProgramCache::path(const std::string& key) const {
+  return m_dir + "/" + key + ".bin";
+}
+
+GLuint ProgramCache::load(const std::string& key) const {
+  std::ifstream file(path(key).c_str(), std::ios::binary);
+  if (!file)
+    return 0;
+
+  char magic[sizeof(MAGIC)];
+  GLenum format;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(&format), sizeof(format));
+  std::vector<char> binary((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+  if (!file.eof() || binary.empty() ||
+      !std::equal(magic, magic + sizeof(MAGIC), MAGIC)) {
+    remove(path(key).c_str());
+    return 0;
+  }
+
+  // O driver pode recusar um binário antigo mesmo com a mesma versão;
+  // nesse caso a entrada é descartada e o programa é recompilado.
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, format, &binary[0], binary.size());
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    glDeleteProgram(program);
+    while (glGetError() != GL_NO_ERROR);
+    remove(path(key).c_str());
+    return 0;
+  }
+
+  return program;
+}
+
+void ProgramCache::store(const std::string& key, GLuint program) const {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  std::vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+  // Escreve em um arquivo temporário e renomeia, para que outra instância
+  // nunca leia uma entrada pela metade.
+  std::stringstream tmp;
+  tmp << path(key) << "." << getpid() << ".tmp";
+  {
+    std::ofstream file(tmp.str().c_str(), std::ios::binary);
+    file.write(MAGIC, sizeof(MAGIC));
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(&binary[0], binary.size());
+    if (!file) {
+      file.close();
+      remove(tmp.str().c_str());
+      return;
+    }
+  }
+  if (rename(tmp.str().c_str(), path(key).c_str()) != 0)
+    remove(tmp.str().c_str());
+}
@@ -0,0 +1,88 @@
+#include "readback.hpp"
+
+#include <cstring>
+
+void Readback::init(GLint width, GLint height, int size, int attachments) {
+  m_width = width;
+  m_height = height;
+  m_attachments = attachments;
+  m_buffers.resize(size);
+  m_fences.assign(size, GLsync(0));
+  m_tags.resize(size);
+  glGenBuffers(size, &m_buffers[0]);
+  for (int i = 0; i < size; ++i) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 3 * sizeof(GLfloat) * width * height * attachments,
+                 NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  m_head = m_tail = 0;
+}
+
+// Enfileira a leitura do frame buffer (cada anexo em sequência, no mesmo
+// PBO). O glReadPixels para um PBO retorna imediatamente. Não deve ser
+// chamado com o anel cheio (ver full()).
+void Readback::request(GLuint fbo, unsigned int tag) {
+  if (m_buffers.empty() || full())
+    return;
+
+  unsigned int i = m_head % m_buffers.size();
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[i]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  size_t size = 3 * sizeof(GLfloat) * m_width * m_height;
+  for (int a = 0; a < m_attachments; ++a) {
+    glReadBuffer(GL_COLOR_ATTACHMENT0 + a);
+    glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_FLOAT, (void*) (a * size));
+  }
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+  m_fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  m_tags[i] = tag;
+  m_head++;
+}
+
+// Retorna a leitura mais antiga se ela já terminou. Com wait, bloqueia até
+// a GPU concluí-la.
+bool Readback::poll(std::vector<float>& image, unsigned int& tag, bool wait) {
+  if (m_head == m_tail)
+    return false;
+
+  unsigned int i = m_tail % m_buffers.size();
+  GLenum status;
+  do {
+    status = glClientWaitSync(m_fences[i], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              wait ? GLuint64(1000000000) : 0);
+  } while (wait && status == GL_TIMEOUT_EXPIRED);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    return false;
+
+  size_t size = 3 * size_t(m_width) * m_height * m_attachments;
+  image.resize(size);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffers[i]);
+  const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size * sizeof(GLfloat), GL_MAP_READ_BIT);
+  if (data) {
+    memcpy(&image[0], data, size * sizeof(GLfloat));
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  glDeleteSync(m_fences[i]);
+  m_fences[i] = 0;
+  tag = m_tags[i];
+  m_tail++;
+  return data != NULL;
+}
+
+void Readback::destroy() {
+  for (size_t i = 0; i < m_fences.size(); ++i)
+    if (m_fences[i])
+      glDeleteSync(m_fences[i]);
+  if (!m_buffers.empty())
+    glDeleteBuffers(m_buffers.size(), &m_buffers[0]);
+  m_buffers.clear();
+  m_fences.clear();
+  m_head = m_tail = 0;
+}
@@ -1,9 +1,78 @@
 #include "renderer.hpp"
+#include "sobol.hpp"
+#include "denoiser.hpp"
+#include "bvh.hpp"
 
 #include <vector>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+// Limite de amostras por passo no modo automático.
+#define MAX_PASS_SAMPLES 64
+
+// Intervalo (em amostras) entre as leituras do erro dos pixels.
+#define ADAPTIVE_CHECK 16
+
+// Tamanho dos arrays do template.glsl (MAX_ARRAY) e limite de luzes
+// (MAX_LIGHTS), que cabe nos 16 KB garantidos para um uniform block.
+#define MAX_ARRAY 16
+#define MAX_LIGHTS 256
+
+// Unidades de textura dos nós e triângulos das malhas, depois das
+// MAX_ARRAY usadas por iChannel; e a pilha do percurso (MESH_STACK no
+// mesh.glsl).
+#define MESH_UNIT MAX_ARRAY
+#define MESH_STACK 64
+
+// Unidades de textura do campo de distância (field.glsl), depois das
+// malhas, e a dos pontos do pré-cálculo; e a largura das linhas de pontos
+// (BAKE_WIDTH no template.glsl) com o número de linhas de cada envio.
+#define FIELD_UNIT (MESH_UNIT + 2)
+#define BAKE_UNIT (FIELD_UNIT + 3)
+#define BAKE_WIDTH 1024
+#define BAKE_ROWS 256
+
+// Unidades do albedo e da normal lidos pelo denoise.glsl, fora das
+// iChannel (onde ficam as texturas da cena) e das usadas pelo shader
+// principal, que escreve nessas mesmas texturas.
+#define DENOISE_UNIT (BAKE_UNIT + 1)
+
+// Espelho do bloco SceneData do template.glsl no layout std140: vetores e
+// elementos de arrays ocupam 16 bytes, por isso os campos de preenchimento.
+struct SceneBlock {
+  struct {GLfloat p[3], r, col[3]; GLint type;} lights[MAX_LIGHTS];
+  struct {GLfloat probability, alias, pdf, pad;} lightTable[MAX_LIGHTS];
+  struct {GLfloat emission[3], alpha, kr, kt, ior, pad;} properties[MAX_ARRAY];
+  struct {GLfloat c[3], pad;} solidColors[MAX_ARRAY];
+  struct {GLfloat c[3], pad;} checkerColorA[MAX_ARRAY], checkerColorB[MAX_ARRAY];
+  struct {GLfloat v, pad[3];} checkerSize[MAX_ARRAY], textureScale[MAX_ARRAY];
+};
+
+static void copy(GLfloat *dst, const vec3& v) {
+  dst[0] = v.x; dst[1] = v.y; dst[2] = v.z;
+}
+
+#ifdef HAVE_EGL
+#include <EGL/eglext.h>
+#endif
+
+// Inicializa a GLEW no contexto atual. Sem servidor X a GLEW 2.1+ reclama
+// da falta de display GLX, mas as funções do núcleo carregam normalmente.
+static void initGLEW() {
+  glewExperimental = GL_TRUE;
+  GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  if (status == GLEW_ERROR_NO_GLX_DISPLAY)
+    status = GLEW_OK;
+#endif
+  if (status != GLEW_OK)
+    throw std::runtime_error("Erro ao iniciar GLEW");
+  glGetError(); // descarta erros gerados pela própria GLEW
+}
 
 void Renderer::setupWindow(int width, int height) {
   if (!glfwInit())
@@ -17,14 +86,71 @@ void Renderer::setupWindow(int width, int height) {
 
   glfwMakeContextCurrent(m_window);
   std::cout << "Versão GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
-  if (glewInit() != GLEW_OK)
-    throw std::runtime_error("Erro ao iniciar GLEW");
+  initGLEW();
 
   glfwGetFramebufferSize(m_window, &m_width, &m_height);
   glClearColor(0.0, 0.0, 0.0, 1.0);
   glfwSetInputMode(m_window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 }
 
+#ifdef HAVE_EGL
+void Renderer::setupHeadless(int width, int height) {
+  m_headless = true;
+  m_display = EGL_NO_DISPLAY;
+  m_context = EGL_NO_CONTEXT;
+
+  // Prefere a plataforma surfaceless da Mesa (funciona sem servidor X,
+  // inclusive no llvmpipe); se não existir, usa o display padrão.
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  if (getPlatformDisplay)
+    m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+  if (m_display == EGL_NO_DISPLAY)
+    m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor))
+    throw std::runtime_error("Erro ao iniciar EGL");
+  if (!eglBindAPI(EGL_OPENGL_API))
+    throw std::runtime_error("EGL não suporta OpenGL");
+
+  const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                  EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglChooseConfig(m_display, configAttribs, &config, 1, &numConfigs))
+    numConfigs = 0;
+
+  // O template usa GL_QUADS, logo é preciso o perfil de compatibilidade.
+  const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3,
+                                   EGL_CONTEXT_MINOR_VERSION, 3,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                   EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+                                   EGL_NONE};
+  m_context = eglCreateContext(m_display, numConfigs ? config : (EGLConfig) 0,
+                               EGL_NO_CONTEXT, contextAttribs);
+  if (m_context == EGL_NO_CONTEXT)
+    throw std::runtime_error("Erro ao criar o contexto EGL");
+
+  // Não há superfície: tudo é desenhado nos FBOs.
+  if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context))
+    throw std::runtime_error("Erro ao ativar o contexto EGL");
+
+  std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl
+            << "Versão GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
+  initGLEW();
+
+  m_width = width;
+  m_height = height;
+}
+#else
+void Renderer::setupHeadless(int width, int height) {
+  throw std::runtime_error("Modo sem janela indisponível: compilado sem EGL");
+}
+#endif
+
 GLuint Renderer::compileShader(GLenum type, const std::string& shader) const {
   GLuint id = glCreateShader(type);
   const GLchar *buffer_ptr = shader.c_str();  
@@ -55,6 +181,8 @@ GLuint Renderer::linkShaders(GLuint vertex, GLuint fragment) const {
 
   glAttachShader(program, vertex);
   glAttachShader(program, fragment);
+  if (m_cache.isEnabled())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(program);
 
   GLint status;
@@ -74,44 +202,126 @@ GLuint Renderer::linkShaders(GLuint vertex, GLuint fragment) const {
   return program;
 }
 
+// Reaproveita o binário do cache em disco quando o código e o driver são os
+// mesmos da última compilação; caso contrário compila e guarda o resultado.
+GLuint Renderer::buildProgram(const std::string& vertex, const std::string& fragment) const {
+  bool cached = m_cache.isEnabled();
+  std::string key;
+  if (cached) {
+    key = m_cache.key(vertex, fragment);
+    GLuint program = m_cache.load(key);
+    if (program)
+      return program;
+  }
+
+  GLuint vertexID = compileShader(GL_VERTEX_SHADER, vertex);
+  GLuint fragmentID = compileShader(GL_FRAGMENT_SHADER, fragment);
+  GLuint program = linkShaders(vertexID, fragmentID);
+  glDeleteShader(vertexID); glDeleteShader(fragmentID);
+
+  if (cached)
+    m_cache.store(key, program);
+  return program;
+}
+
 void Renderer::setupFBO() {
   if (m_width <= 0 || m_height <= 0)
     throw std::runtime_error("O tamanho do frame buffer é inválido!");
 
-  // Prepara a textura para o estimador de monte carlo.
+  // Prepara as texturas para o estimador de monte carlo. São dois pares:
+  // cada amostra lê a média (e os momentos) anterior de um e escreve a
+  // nova no outro, evitando ler e escrever a mesma textura no mesmo passo.
+  // Os momentos guardam E[L²], o número de amostras e o erro de cada pixel.
   GLfloat *texture = new GLfloat[3 * m_width * m_height];
+  GLfloat *moments = new GLfloat[3 * m_width * m_height];
   for (GLint i = 0; i < 3 * m_width * m_height; ++i)
-    texture[i] = 0.0f;
+    texture[i] = moments[i] = 0.0f;
+  for (GLint i = 0; i < m_width * m_height; ++i)
+    moments[3*i + 2] = 1e30f;
   
-  GLuint mcTextureID;
-  glGenTextures(1, &mcTextureID);
+  // O stencil marca os pixels convergidos na amostragem adaptativa e é o
+  // mesmo nos dois frame buffers.
+  glGenRenderbuffers(1, &m_stencil);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_stencil);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  // Com o denoiser, o albedo e a normal/profundidade de cada amostra são
+  // somados pelo blending em texturas únicas, ligadas aos dois frame
+  // buffers. O alpha do albedo conta as amostras, que recomeçam do zero ao
+  // retomar um checkpoint.
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, mcTextureID);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, m_width, m_height, 0, GL_RGB, GL_FLOAT, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  delete[] texture;
+  if (m_denoise) {
+    GLint units;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+    if (units < DENOISE_UNIT + 2)
+      throw std::runtime_error("O driver não tem unidades de textura suficientes para o denoiser");
+    std::vector<GLfloat> zero(4 * m_width * m_height, 0.0f);
+    glGenTextures(2, m_aux);
+    glGenTextures(2, m_filter);
+    glGenFramebuffers(2, m_filterFBO);
+    for (int i = 0; i < 2; ++i) {
+      glBindTexture(GL_TEXTURE_2D, m_aux[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_width, m_height, 0, GL_RGBA, GL_FLOAT, &zero[0]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glBindTexture(GL_TEXTURE_2D, m_filter[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_width, m_height, 0, GL_RGBA, GL_FLOAT, &zero[0]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glBindFramebuffer(GL_FRAMEBUFFER, m_filterFBO[i]);
+      glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_filter[i], 0);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("ERRO INTERNO: Frame buffer está incompleto!");
+    }
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnablei(GL_BLEND, 2);
+    glEnablei(GL_BLEND, 3);
+  }
+
+  glGenTextures(2, m_accum);
+  glGenTextures(2, m_moments);
+  glGenFramebuffers(2, m_fbo);
+  for (int i = 0; i < 2; ++i) {
+    glBindTexture(GL_TEXTURE_2D, m_accum[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, m_width, m_height, 0, GL_RGB, GL_FLOAT, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, m_moments[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, m_width, m_height, 0, GL_RGB, GL_FLOAT, moments);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-  // Prepara o framebuffer
-  glGenFramebuffers(1, &m_fbo);
-  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mcTextureID, 0);
-  GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0};
-  glDrawBuffers(1, drawBuffers);
+    // Prepara o framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo[i]);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_accum[i], 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_moments[i], 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_stencil);
+    GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1,
+                            GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+    if (m_denoise) {
+      glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, m_aux[0], 0);
+      glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, m_aux[1], 0);
+    }
+    glDrawBuffers(m_denoise ? 4 : 2, drawBuffers);
   
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    throw std::runtime_error("ERRO INTERNO: Frame buffer está incompleto!");  
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      throw std::runtime_error("ERRO INTERNO: Frame buffer está incompleto!");  
+  }
+  delete[] texture;
+  delete[] moments;
+  glClearStencil(0);
+  glClear(GL_STENCIL_BUFFER_BIT);
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  m_current = 0;
 }
 
-void Renderer::setupProgram(const std::string& vertex, const std::string& fragment, const std::string& blit) {
-  GLuint vertexID = compileShader(GL_VERTEX_SHADER, vertex);
-  GLuint fragmentID = compileShader(GL_FRAGMENT_SHADER, fragment);
-  GLuint blitID = compileShader(GL_FRAGMENT_SHADER, blit);
-
-  m_blitProgram = linkShaders(vertexID, blitID);
-  m_mainProgram = linkShaders(vertexID, fragmentID);
-  glDeleteShader(vertexID); glDeleteShader(fragmentID); glDeleteShader(blitID);
+void Renderer::setupProgram(const std::string& vertex, const std::string& fragment, const std::string& blit,
+                            const std::string& converge, const std::string& denoise) {
+  m_blitProgram = buildProgram(vertex, blit);
+  m_mainProgram = buildProgram(vertex, fragment);
+  m_convergeProgram = buildProgram(vertex, converge);
+  m_denoiseProgram = buildProgram(vertex, denoise);
   
   GLfloat vertices[16] = {-1.0,  1.0, 0.0, 1.0,
                           -1.0, -1.0, 0.0, 1.0,
@@ -125,40 +335,678 @@ void Renderer::setupProgram(const std::string& vertex, const std::string& fragme
   glEnableVertexAttribArray(0);
 }
 
+// Envia luzes, propriedades e materiais para o uniform buffer do shader.
+// Pode ser chamado a qualquer momento para alterar a cena sem recompilar.
+void Renderer::uploadScene(const Scene& scene) {
+  if (scene.lights.size() > MAX_LIGHTS)
+    throw std::runtime_error("A cena excede o limite de luzes");
+  if (scene.properties.size() > MAX_ARRAY || scene.materials.size() > MAX_ARRAY)
+    throw std::runtime_error("A cena excede o limite de propriedades ou materiais");
+
+  SceneBlock block;
+  memset(&block, 0, sizeof(block));
+
+  std::vector<float> pdf = lightDistribution(scene.lights);
+  std::vector<LightAlias> table = lightAliasTable(pdf);
+  for (size_t i = 0; i < scene.lights.size(); ++i) {
+    const SceneLight& light = scene.lights[i];
+    copy(block.lights[i].p, light.position);
+    copy(block.lights[i].col, light.color);
+    block.lights[i].r = light.radius;
+    block.lights[i].type = light.type;
+    block.lightTable[i].probability = table[i].probability;
+    block.lightTable[i].alias = table[i].alias;
+    block.lightTable[i].pdf = pdf[i];
+  }
+
+  for (size_t i = 0; i < scene.properties.size(); ++i) {
+    const SceneProperties& pr = scene.properties[i];
+    copy(block.properties[i].emission, pr.emission);
+    block.properties[i].alpha = pr.alpha;
+    block.properties[i].kr = pr.kr;
+    block.properties[i].kt = pr.kt;
+    block.properties[i].ior = pr.ior;
+  }
+
+  for (size_t i = 0; i < scene.materials.size(); ++i) {
+    const SceneMaterial& m = scene.materials[i];
+    if (m.type == 0) {
+      copy(block.solidColors[m.index].c, m.colorA);
+    } else if (m.type == 1) {
+      copy(block.checkerColorA[m.index].c, m.colorA);
+      copy(block.checkerColorB[m.index].c, m.colorB);
+      block.checkerSize[m.index].v = m.size;
+    } else if (m.type == 2) {
+      block.textureScale[m.index].v = m.size;
+    }
+  }
+
+  if (!m_sceneUBO)
+    glGenBuffers(1, &m_sceneUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_sceneUBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STATIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_sceneUBO);
+
+  GLuint blockIndex = glGetUniformBlockIndex(m_mainProgram, "SceneData");
+  if (blockIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(m_mainProgram, blockIndex, 0);
+
+  glUseProgram(m_mainProgram);
+  glUniform1i(glGetUniformLocation(m_mainProgram, "nLights"), scene.lights.size());
+
+  if (!scene.meshes.empty())
+    uploadMeshes(scene.meshes);
+}
+
+// Constrói a TriangleBVH e a envia em duas buffer textures RGBA32F: dois
+// texels por nó e três por triângulo, no formato lido pelo mesh.glsl.
+void Renderer::uploadMeshes(const std::vector<SceneMesh>& meshes) {
+  TriangleBVH bvh(meshes);
+  const std::vector<BVHNode>& nodes = bvh.nodes();
+  const std::vector<MeshTriangle>& triangles = bvh.triangles();
+
+  GLint units, texels;
+  glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+  if (units < MESH_UNIT + 2)
+    throw std::runtime_error("O driver não tem unidades de textura suficientes para malhas");
+  if (double(3 * triangles.size()) > texels || double(2 * nodes.size()) > texels ||
+      triangles.size() > (1u << 24) || nodes.size() > (1u << 24))
+    throw std::runtime_error("As malhas da cena têm triângulos demais");
+  if (bvh.depth() > MESH_STACK)
+    throw std::runtime_error("A hierarquia das malhas é profunda demais");
+
+  std::vector<GLfloat> nodeData(8 * nodes.size()), triangleData(12 * triangles.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const BVHNode& n = nodes[i];
+    GLfloat *d = &nodeData[8*i];
+    copy(d, n.box.lo);
+    d[3] = n.count > 0 ? n.first : n.right;
+    copy(d + 4, n.box.hi);
+    d[7] = n.count;
+  }
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    const MeshTriangle& t = triangles[i];
+    GLfloat *d = &triangleData[12*i];
+    copy(d, t.v0);
+    d[3] = t.object;
+    copy(d + 4, t.e1);
+    copy(d + 8, t.e2);
+  }
+
+  const std::vector<GLfloat> *data[2] = {&nodeData, &triangleData};
+  if (!m_meshBuffers[0]) {
+    glGenBuffers(2, m_meshBuffers);
+    glGenTextures(2, m_meshTextures);
+  }
+  for (int i = 0; i < 2; ++i) {
+    glBindBuffer(GL_TEXTURE_BUFFER, m_meshBuffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, data[i]->size() * sizeof(GLfloat), &(*data[i])[0], GL_STATIC_DRAW);
+    glActiveTexture(GL_TEXTURE0 + MESH_UNIT + i);
+    glBindTexture(GL_TEXTURE_BUFFER, m_meshTextures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_meshBuffers[i]);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+// Avalia o map() do próprio shader nos pontos pedidos pelo DistanceField e
+// envia o campo resultante. O programa de pré-cálculo é o fragment shader
+// principal com BAKE_FIELD definido: cada envio desenha até BAKE_ROWS
+// linhas de pontos em uma textura R32F, lida de volta em seguida.
+void Renderer::bakeField(DistanceField& field, const Scene& scene, int resolution,
+                         const std::string& vertex, const std::string& fragment) {
+  GLint units, texels;
+  glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+  if (units < BAKE_UNIT + 1)
+    throw std::runtime_error("O driver não tem unidades de textura suficientes para o campo de distância");
+
+  std::string source = fragment;
+  source.insert(source.find('\n') + 1, "#define BAKE_FIELD\n");
+  GLuint program = buildProgram(vertex, source);
+
+  GLuint buffer, points, target, fbo;
+  glGenBuffers(1, &buffer);
+  glGenTextures(1, &points);
+  glGenTextures(1, &target);
+  glGenFramebuffers(1, &fbo);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, target);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, BAKE_WIDTH, BAKE_ROWS, 0, GL_RED, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, 0);
+  GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+  glDrawBuffers(1, &drawBuffer);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw std::runtime_error("ERRO INTERNO: Frame buffer está incompleto!");
+
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "bakePoints"), BAKE_UNIT);
+  glActiveTexture(GL_TEXTURE0 + BAKE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, points);
+  size_t batch = std::min<size_t>(BAKE_WIDTH * BAKE_ROWS, texels);
+
+  field.bake(scene, resolution, [&](const std::vector<vec3>& p, std::vector<float>& d) {
+    std::vector<GLfloat> data(4 * batch), result(BAKE_WIDTH * BAKE_ROWS);
+    d.resize(p.size());
+    for (size_t first = 0; first < p.size(); first += batch) {
+      size_t count = std::min(batch, p.size() - first);
+      for (size_t i = 0; i < count; ++i)
+        copy(&data[4*i], p[first + i]);
+      glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+      glBufferData(GL_TEXTURE_BUFFER, 4 * count * sizeof(GLfloat), &data[0], GL_STREAM_DRAW);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+
+      GLint rows = (count + BAKE_WIDTH - 1) / BAKE_WIDTH;
+      glViewport(0, 0, BAKE_WIDTH, rows);
+      glDrawArrays(GL_QUADS, 0, 4);
+      glReadPixels(0, 0, BAKE_WIDTH, rows, GL_RED, GL_FLOAT, &result[0]);
+      std::copy(result.begin(), result.begin() + count, d.begin() + first);
+    }
+  });
+
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glUseProgram(0);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &target);
+  glDeleteTextures(1, &points);
+  glDeleteBuffers(1, &buffer);
+  glDeleteProgram(program);
+  uploadField(field);
+}
+
+// Envia as três texturas do field.glsl: as amostras da grade grossa e o
+// atlas dos blocos com filtro linear, e o índice de blocos com inteiros.
+void Renderer::uploadField(const DistanceField& field) {
+  const int *cells = field.cells(), *atlas = field.atlas();
+  GLint maxSize;
+  glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+  if (cells[0] + 1 > maxSize || cells[1] + 1 > maxSize || cells[2] + 1 > maxSize ||
+      atlas[0] * FIELD_BRICK > maxSize || atlas[2] * FIELD_BRICK > maxSize)
+    throw std::runtime_error("O campo de distância excede o tamanho máximo de textura 3D");
+
+  if (!m_fieldTextures[0])
+    glGenTextures(3, m_fieldTextures);
+  std::vector<float> bricks = field.atlasTexels();
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int i = 0; i < 3; ++i) {
+    glActiveTexture(GL_TEXTURE0 + FIELD_UNIT + i);
+    glBindTexture(GL_TEXTURE_3D, m_fieldTextures[i]);
+    if (i == 0)
+      glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, cells[0] + 1, cells[1] + 1, cells[2] + 1, 0,
+                   GL_RED, GL_FLOAT, &field.coarse()[0]);
+    else if (i == 1)
+      glTexImage3D(GL_TEXTURE_3D, 0, GL_R32I, cells[0], cells[1], cells[2], 0,
+                   GL_RED_INTEGER, GL_INT, &field.index()[0]);
+    else
+      glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, atlas[0] * FIELD_BRICK, atlas[1] * FIELD_BRICK,
+                   atlas[2] * FIELD_BRICK, 0, GL_RED, GL_FLOAT, &bricks[0]);
+    GLint filter = i == 1 ? GL_NEAREST : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  glUseProgram(m_mainProgram);
+  vec3 lo = field.lo();
+  glUniform3f(glGetUniformLocation(m_mainProgram, "fieldLo"), lo.x, lo.y, lo.z);
+  glUniform1f(glGetUniformLocation(m_mainProgram, "fieldCell"), field.cell());
+  glUniform3i(glGetUniformLocation(m_mainProgram, "fieldCells"), cells[0], cells[1], cells[2]);
+  glUniform3i(glGetUniformLocation(m_mainProgram, "fieldAtlas"), atlas[0], atlas[1], atlas[2]);
+}
+
 bool Renderer::scapeKey = false;
 void keyboardCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
   if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
     Renderer::scapeKey = true;
 }
 
-void Renderer::render() {
-  GLuint N = 0; // número de amostras calculadas.
-  glfwSetKeyCallback(m_window, keyboardCallback);
-  
-  setupFBO();
-  glViewport(0, 0, m_width, m_height);
-
+void Renderer::setupUniforms() {
   glUseProgram(m_blitProgram);
   GLint blitResLoc = glGetUniformLocation(m_blitProgram, "iResolution");
-  GLint blitTexLoc = glGetUniformLocation(m_mainProgram, "iChannel");
+  GLint blitTexLoc = glGetUniformLocation(m_blitProgram, "blitTexture");
   glUniform2f(blitResLoc, m_width, m_height);
   glUniform1i(blitTexLoc, 0);
   
   glUseProgram(m_mainProgram);
   GLint resLoc = glGetUniformLocation(m_mainProgram, "iResolution");
-  GLint timeLoc = glGetUniformLocation(m_mainProgram, "time");
-  GLint lightLoc = glGetUniformLocation(m_mainProgram, "nLights");
   GLint texLoc = glGetUniformLocation(m_mainProgram, "iChannel");
-  GLint sampleNLoc = glGetUniformLocation(m_mainProgram, "sampleNumber");
-  glUniform1i(lightLoc, m_lights);
+  m_timeLoc = glGetUniformLocation(m_mainProgram, "time");
+  m_passLoc = glGetUniformLocation(m_mainProgram, "samplesPerPass");
   glUniform2f(resLoc, m_width, m_height);
+  glUniform1ui(glGetUniformLocation(m_mainProgram, "adaptiveMin"), m_adaptiveMin);
+
+  // Matrizes geradoras do amostrador, enviadas uma única vez.
+  std::vector<uint32_t> sobol = sobolMatrices();
+  glUniform1uiv(glGetUniformLocation(m_mainProgram, "sobolMatrix"), sobol.size(), &sobol[0]);
 
   // 16 é o valor de MAX_ARRAY no template.glsl
   // se for alterar esse valor, altere-o no template também.
   // Eu sei que isso não é ótimo, mas preciso entregar o TP logo...
   for (GLint i = 0; i < 16; ++i)
     glUniform1i(texLoc+i, i);
+  glUniform1i(glGetUniformLocation(m_mainProgram, "meshNodes"), MESH_UNIT);
+  glUniform1i(glGetUniformLocation(m_mainProgram, "meshTriangles"), MESH_UNIT + 1);
+  glUniform1i(glGetUniformLocation(m_mainProgram, "fieldCoarse"), FIELD_UNIT);
+  glUniform1i(glGetUniformLocation(m_mainProgram, "fieldIndex"), FIELD_UNIT + 1);
+  glUniform1i(glGetUniformLocation(m_mainProgram, "fieldBricks"), FIELD_UNIT + 2);
+
+  glUseProgram(m_convergeProgram);
+  glUniform2f(glGetUniformLocation(m_convergeProgram, "iResolution"), m_width, m_height);
+  glUniform1i(glGetUniformLocation(m_convergeProgram, "accumTexture"), 0);
+  glUniform1i(glGetUniformLocation(m_convergeProgram, "momentsTexture"), 1);
+  glUniform1f(glGetUniformLocation(m_convergeProgram, "threshold"), m_adaptive);
 
+  glUseProgram(m_denoiseProgram);
+  glUniform2f(glGetUniformLocation(m_denoiseProgram, "iResolution"), m_width, m_height);
+  glUniform1i(glGetUniformLocation(m_denoiseProgram, "colorTexture"), 0);
+  glUniform1i(glGetUniformLocation(m_denoiseProgram, "momentsTexture"), 1);
+  glUniform1i(glGetUniformLocation(m_denoiseProgram, "albedoTexture"), DENOISE_UNIT);
+  glUniform1i(glGetUniformLocation(m_denoiseProgram, "normalTexture"), DENOISE_UNIT + 1);
+  glUniform1f(glGetUniformLocation(m_denoiseProgram, "sigmaLuminance"), DENOISE_SIGMA_LUMINANCE);
+  glUniform1f(glGetUniformLocation(m_denoiseProgram, "sigmaNormal"), DENOISE_SIGMA_NORMAL);
+  glUniform1f(glGetUniformLocation(m_denoiseProgram, "sigmaDepth"), DENOISE_SIGMA_DEPTH);
+  glUniform1f(glGetUniformLocation(m_denoiseProgram, "albedoFloor"), DENOISE_ALBEDO_FLOOR);
+}
+
+// Número de pixels do bloco t (os blocos da borda podem ser menores).
+GLint Renderer::tilePixels(GLint t) const {
+  GLint x = (t % m_tilesX) * m_tileSize, y = (t / m_tilesX) * m_tileSize;
+  return std::min(m_tileSize, m_width - x) * std::min(m_tileSize, m_height - y);
+}
+
+// Faz um envio à GPU: desenha os próximos blocos do passo atual, tantos
+// quantos couberem no orçamento de trabalho. Um passo calcula count
+// amostras em todos os blocos que ainda não convergiram; só quando o
+// último bloco termina os buffers de acumulação são trocados. Retorna o
+// número de amostras concluídas (zero enquanto o passo não termina).
+GLuint Renderer::renderStep(GLuint maxSamples, float time) {
+  GLint tiles = m_tilesX * m_tilesY;
+  if (m_nextTile == 0) {
+    GLuint count = m_passSamples;
+    if (count == 0) {
+      double fit = m_work / (double(m_width) * m_height);
+      count = std::max(1.0, std::min(fit, double(MAX_PASS_SAMPLES)));
+    }
+    m_passCount = std::min(count, maxSamples);
+  }
+
+  GLint first = m_nextTile, last = first + 1;
+  double work = double(tilePixels(first)) * m_passCount;
+  while (last < tiles && work + double(tilePixels(last)) * m_passCount <= m_work)
+    work += double(tilePixels(last++)) * m_passCount;
+
+  int next = 1 - m_current;
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_accum[m_current]);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_moments[m_current]);
+  glActiveTexture(GL_TEXTURE0);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo[next]);
+  glUseProgram(m_mainProgram);
+  glUniform1f(m_timeLoc, time);
+  glUniform1ui(m_passLoc, m_passCount);
+
+  // Pixels convergidos estão marcados no stencil e são descartados antes
+  // do shader.
+  if (m_adaptive > 0.0f) {
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_EQUAL, 0, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  }
+  bool timed = m_timer.begin(work, m_stats.frame());
+  if (timed)
+    m_stats.timed(FrameStats::TRACE);
+  m_stats.addWork(work);
+  if (first == 0 && last == tiles) {
+    glDrawArrays(GL_QUADS, 0, 4);
+  } else {
+    glEnable(GL_SCISSOR_TEST);
+    for (GLint t = first; t < last; ++t) {
+      glScissor((t % m_tilesX) * m_tileSize, (t / m_tilesX) * m_tileSize,
+                m_tileSize, m_tileSize);
+      glDrawArrays(GL_QUADS, 0, 4);
+    }
+    glDisable(GL_SCISSOR_TEST);
+  }
+  if (timed)
+    m_timer.end();
+  glDisable(GL_STENCIL_TEST);
+
+  m_nextTile = last;
+  if (m_nextTile < tiles)
+    return 0;
+  m_nextTile = 0;
+  m_current = next;
+  return m_passCount;
+}
+
+// Ajusta o trabalho de cada envio (em amostras de pixel) para que ele
+// leve cerca de m_frameTime ms na GPU. O crescimento é limitado a 2x por
+// medida para não estourar o tempo quando a estimativa ainda é ruim.
+void Renderer::updateWorkBudget() {
+  double ms, work;
+  unsigned int frame;
+  while (m_timer.poll(ms, work, frame)) {
+    m_stats.gpuTime(frame, FrameStats::TRACE, ms);
+    if (ms <= 0.0)
+      continue;
+    double target = m_frameTime * work / ms;
+    m_work = std::max(1.0, std::min(target, 2.0 * m_work));
+  }
+}
+
+// As estatísticas identificam o driver pelas strings da OpenGL, por isso
+// precisam do contexto já criado.
+void Renderer::setStats(const std::string& path) {
+  std::string renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+  std::string version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+  m_stats.open(path, renderer + " (" + version + ")", m_width, m_height);
+}
+
+// Mede o tempo de GPU de uma etapa do quadro além do traçado (denoiser e
+// blit). Sem estatísticas, ou com o anel cheio, a etapa não é medida.
+bool Renderer::beginStage(FrameStats::Stage stage) {
+  return m_stats.enabled() && m_stageTimer.begin(stage, m_stats.frame());
+}
+
+void Renderer::endStage(FrameStats::Stage stage) {
+  m_stageTimer.end();
+  m_stats.timed(stage);
+}
+
+void Renderer::pollStages() {
+  double ms, stage;
+  unsigned int frame;
+  while (m_stageTimer.poll(ms, stage, frame))
+    m_stats.gpuTime(frame, FrameStats::Stage(int(stage)), ms);
+}
+
+// Espera as consultas pendentes e grava o resumo das estatísticas.
+void Renderer::finishStats() {
+  if (!m_stats.enabled())
+    return;
+  glFinish();
+  updateWorkBudget();
+  pollStages();
+  m_stats.finish();
+}
+
+void Renderer::setCheckpoint(GLuint every, const std::string& path, unsigned long long sceneHash) {
+  m_checkpointEvery = every;
+  m_checkpointPath = path;
+  m_sceneHash = sceneHash;
+}
+
+// Continua a partir da média salva: render() carrega a imagem e os
+// momentos nos buffers de acumulação e começa da amostra seguinte.
+void Renderer::resume(const Checkpoint& checkpoint) {
+  m_startSamples = checkpoint.samples;
+  m_startImage = checkpoint.data;
+  m_startMoments = checkpoint.moments;
+}
+
+// Limita o passo para que ele termine exatamente na próxima imagem parcial
+// ou no próximo checkpoint.
+GLuint Renderer::passLimit(GLuint N, GLuint total) const {
+  GLuint limit = total - N;
+  if (m_snapshotEvery > 0)
+    limit = std::min(limit, m_snapshotEvery - N % m_snapshotEvery);
+  if (m_checkpointEvery > 0)
+    limit = std::min(limit, m_checkpointEvery - N % m_checkpointEvery);
+  return limit;
+}
+
+bool Renderer::wantsReadback(GLuint N) const {
+  return (m_snapshotEvery > 0 && N % m_snapshotEvery == 0) ||
+         (m_checkpointEvery > 0 && N % m_checkpointEvery == 0);
+}
+
+bool Renderer::converged() const {
+  return m_adaptive > 0.0f && m_convergedPixels >= GLint64(m_width) * m_height;
+}
+
+// Marca no stencil os pixels cujo erro já está abaixo de m_adaptive. O
+// shader converge.glsl copia o estado desses pixels para o outro buffer,
+// já que os passos seguintes não os escrevem mais, e uma occlusion query
+// conta quantos foram marcados.
+void Renderer::markConverged() {
+  GLuint query;
+  glGenQueries(1, &query);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_accum[m_current]);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_moments[m_current]);
+  glActiveTexture(GL_TEXTURE0);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo[1 - m_current]);
+  glUseProgram(m_convergeProgram);
+  glEnable(GL_STENCIL_TEST);
+  glStencilFunc(GL_GREATER, 1, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  // As somas auxiliares não têm ping-pong e não podem ser tocadas aqui.
+  glColorMaski(2, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glColorMaski(3, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glBeginQuery(GL_SAMPLES_PASSED, query);
+  glDrawArrays(GL_QUADS, 0, 4);
+  glEndQuery(GL_SAMPLES_PASSED);
+  glColorMaski(2, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glColorMaski(3, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glDisable(GL_STENCIL_TEST);
+  m_convergeQueries.push_back(query);
+}
+
+// Soma os pixels marcados pelas consultas que a GPU já concluiu.
+void Renderer::pollConverged() {
+  while (!m_convergeQueries.empty()) {
+    GLuint query = m_convergeQueries.front(), available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return;
+    GLuint64 pixels = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &pixels);
+    m_convergedPixels += pixels;
+    glDeleteQueries(1, &query);
+    m_convergeQueries.pop_front();
+  }
+}
+
+// Pede a leitura da média com N amostras. Se o anel de PBOs estiver cheio,
+// espera a leitura mais antiga, que segue para a thread de escrita.
+void Renderer::requestReadback(GLuint N) {
+  collectSnapshots(false);
+  if (m_readback.full()) {
+    std::vector<float> image;
+    unsigned int samples;
+    if (m_readback.poll(image, samples, true))
+      deliverReadback(image, samples);
+  }
+  m_readback.request(m_fbo[m_current], N);
+  m_lastRead = N;
+}
+
+// Ao fim de cada passo: pede as leituras de imagens parciais e checkpoints
+// e, periodicamente, marca os pixels convergidos.
+void Renderer::finishPass(GLuint N) {
+  if (wantsReadback(N))
+    requestReadback(N);
+  if (m_adaptive > 0.0f) {
+    pollConverged();
+    if (N >= m_lastCheck + ADAPTIVE_CHECK) {
+      markConverged();
+      m_lastCheck = N;
+    }
+  }
+}
+
+// Entrega à thread de escrita as leituras que a GPU já concluiu.
+void Renderer::collectSnapshots(bool wait) {
+  std::vector<float> image;
+  unsigned int samples;
+  while (m_readback.poll(image, samples, wait))
+    deliverReadback(image, samples);
+}
+
+// Uma mesma leitura pode servir ao checkpoint (este também ao final do
+// modo sem janela) e à imagem parcial. Com momentos, eles vêm depois da
+// média.
+void Renderer::deliverReadback(std::vector<float>& image, GLuint samples) {
+  size_t size = 3 * size_t(m_width) * m_height;
+  if (m_checkpointEvery > 0 &&
+      (samples % m_checkpointEvery == 0 || (m_headless && samples == m_stopSamples))) {
+    std::shared_ptr<Checkpoint> checkpoint(new Checkpoint);
+    checkpoint->backend = Checkpoint::GPU;
+    checkpoint->width = m_width;
+    checkpoint->height = m_height;
+    checkpoint->samples = samples;
+    checkpoint->sceneHash = m_sceneHash;
+    checkpoint->data.assign(image.begin(), image.begin() + size);
+    checkpoint->moments.assign(image.begin() + size, image.end());
+    std::string path = m_checkpointPath;
+    m_writer.push([checkpoint, path]() {checkpoint->save(path);});
+  }
+  if (m_snapshotEvery > 0 && samples % m_snapshotEvery == 0) {
+    image.resize(size);
+    m_writer.push(snapshotPath(m_snapshotPath, samples), image, m_width, m_height);
+  }
+}
+
+// Filtra a média atual com o à-trous do denoise.glsl: um passo prepara a
+// iluminação e a tolerância de cada pixel, e os seguintes alternam entre
+// as duas texturas do filtro. Retorna a textura com o resultado.
+GLuint Renderer::denoiseImage() {
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_moments[m_current]);
+  glActiveTexture(GL_TEXTURE0 + DENOISE_UNIT);
+  glBindTexture(GL_TEXTURE_2D, m_aux[0]);
+  glActiveTexture(GL_TEXTURE0 + DENOISE_UNIT + 1);
+  glBindTexture(GL_TEXTURE_2D, m_aux[1]);
+  glActiveTexture(GL_TEXTURE0);
+  glUseProgram(m_denoiseProgram);
+  GLint stepLoc = glGetUniformLocation(m_denoiseProgram, "stepWidth");
+  GLint remodulateLoc = glGetUniformLocation(m_denoiseProgram, "remodulate");
+
+  GLuint input = m_accum[m_current];
+  int out = 0;
+  for (int i = 0; i <= DENOISE_ITERATIONS; ++i) {
+    glBindTexture(GL_TEXTURE_2D, input);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_filterFBO[out]);
+    glUniform1i(stepLoc, i == 0 ? 0 : 1 << (i - 1));
+    glUniform1i(remodulateLoc, i == DENOISE_ITERATIONS);
+    glDrawArrays(GL_QUADS, 0, 4);
+    input = m_filter[out];
+    out = 1 - out;
+  }
+  return input;
+}
+
+void Renderer::blit(GLuint texture) {
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glUseProgram(m_blitProgram);
+  glDrawArrays(GL_QUADS, 0, 4);
+}
+
+// Calcula um número fixo de amostras o mais rápido possível, sem blit
+// nem swap (e portanto sem vsync).
+void Renderer::renderHeadless() {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point initTime = Clock::now();
+
+  // Com amostragem adaptativa, para assim que todos os blocos convergirem.
+  GLuint N = m_startSamples;
+  while (N < m_samples && !converged()) {
+    std::chrono::duration<double> elapsed = Clock::now() - initTime;
+    m_stats.beginFrame();
+    updateWorkBudget();
+    collectSnapshots(false);
+    GLuint done = renderStep(passLimit(N, m_samples), m_time >= 0.0 ? m_time : elapsed.count());
+    N += done;
+    if (done > 0)
+      finishPass(N);
+    m_stats.endFrame(N);
+    // O tempo até a primeira amostra inclui a execução na GPU.
+    if (done > 0 && N == m_startSamples + done) {
+      glFinish();
+      m_firstSample = Clock::now();
+    }
+  }
+  // O checkpoint final permite continuar depois com mais amostras.
+  m_stopSamples = N;
+  if (m_checkpointEvery > 0 && N > m_startSamples && m_lastRead != N)
+    requestReadback(N);
+  glFinish();
+  collectSnapshots(true);
+  pollConverged();
+
+  std::chrono::duration<double> elapsed = Clock::now() - initTime;
+  m_renderTime = elapsed.count();
+  m_renderedSamples = N - m_startSamples;
+  finishStats();
+  if (converged())
+    std::cout << "Todos os pixels convergiram." << std::endl;
+  std::cout << "Amostras: " << N << std::endl
+            << "Finalizado!" << std::endl
+            << "Tempo: " << elapsed.count() << std::endl
+            << "Amostras/s: " << (N - m_startSamples) / elapsed.count() << std::endl;
+}
+
+void Renderer::render() {
+  GLuint N = m_startSamples; // número de amostras calculadas.
+  
+  setupFBO();
+  if (!m_startImage.empty()) {
+    if (m_startImage.size() != 3 * size_t(m_width) * m_height)
+      throw std::runtime_error("O checkpoint tem tamanho diferente da imagem!");
+    glBindTexture(GL_TEXTURE_2D, m_accum[m_current]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, GL_RGB, GL_FLOAT, &m_startImage[0]);
+    std::vector<float>().swap(m_startImage);
+  }
+  if (!m_startMoments.empty()) {
+    if (m_startMoments.size() != 3 * size_t(m_width) * m_height)
+      throw std::runtime_error("O checkpoint tem tamanho diferente da imagem!");
+    glBindTexture(GL_TEXTURE_2D, m_moments[m_current]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, GL_RGB, GL_FLOAT, &m_startMoments[0]);
+    std::vector<float>().swap(m_startMoments);
+  }
+  glViewport(0, 0, m_width, m_height);
+  setupUniforms();
+  // Com estatísticas, anéis maiores deixam menos quadros sem medida.
+  m_timer.init(m_stats.enabled() ? 8 : 4);
+  if (m_stats.enabled())
+    m_stageTimer.init(8);
+
+  // Começa com um único bloco por envio; o orçamento cresce conforme as
+  // medidas de tempo chegam.
+  m_tilesX = (m_width + m_tileSize - 1) / m_tileSize;
+  m_tilesY = (m_height + m_tileSize - 1) / m_tileSize;
+  m_nextTile = 0;
+  m_work = tilePixels(0);
+  m_convergedPixels = 0;
+  m_lastCheck = m_lastRead = N;
+  if (m_adaptive > 0.0f && N > 0)
+    markConverged();
+  // Os checkpoints também leem os momentos.
+  if (m_checkpointEvery > 0)
+    m_readback.init(m_width, m_height, 3, 2);
+  else if (m_snapshotEvery > 0)
+    m_readback.init(m_width, m_height);
+
+  if (m_headless) {
+    renderHeadless();
+    return;
+  }
+
+  glfwSetKeyCallback(m_window, keyboardCallback);
   bool hasRendered = false;
   bool static_render = m_time >= 0.0;
 
@@ -166,9 +1014,11 @@ void Renderer::render() {
 
   double initTime = glfwGetTime();
   glfwSwapInterval(1);
+  GLuint display = m_denoise ? m_filter[0] : 0;
   while (!glfwWindowShouldClose(m_window)) {
     glfwPollEvents();
     if (Renderer::scapeKey && !hasRendered) {
+      finishStats();
       std::cout << "Amostras: " << N << std::endl
                 << "Finalizado!" << std::endl
                 << "Tempo: " << glfwGetTime() - initTime << std::endl;
@@ -177,28 +1027,109 @@ void Renderer::render() {
     if (hasRendered || Renderer::scapeKey) continue;
 
     
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-    glUseProgram(m_mainProgram);
-    glUniform1f(timeLoc, static_render ? m_time : glfwGetTime());
-    glUniform1ui(sampleNLoc, N++);
-    glDrawArrays(GL_QUADS, 0, 4);
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glUseProgram(m_blitProgram);
-    glDrawArrays(GL_QUADS, 0, 4);
+    m_stats.beginFrame();
+    updateWorkBudget();
+    pollStages();
+    collectSnapshots(false);
+    GLuint done = converged() ? 0 : renderStep(passLimit(N, ~0u), static_render ? m_time : glfwGetTime());
+    N += done;
+    if (done > 0)
+      finishPass(N);
+    // O filtro só roda quando a média muda.
+    if (m_denoise && done > 0) {
+      bool timed = beginStage(FrameStats::DENOISE);
+      display = denoiseImage();
+      if (timed)
+        endStage(FrameStats::DENOISE);
+    }
+    bool timed = beginStage(FrameStats::BLIT);
+    blit(m_denoise ? display : m_accum[m_current]);
+    if (timed)
+      endStage(FrameStats::BLIT);
+    m_stats.endFrame(N);
     
     glfwSwapBuffers(m_window);
     
-    if (static_render)
+    if (static_render && N > 0)
       hasRendered =true;
   }
 }
 
+// Lê a média acumulada (RGB float, linhas de baixo para cima). Feito uma
+// única vez, ao final da renderização.
+std::vector<float> Renderer::readImage() {
+  std::vector<float> image(3 * m_width * m_height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo[m_current]);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_FLOAT, &image[0]);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  return image;
+}
+
+// Lê os buffers do denoiser no formato de denoise(): momentos e as somas
+// do albedo e da normal/profundidade.
+void Renderer::readAuxiliary(std::vector<float>& moments, std::vector<float>& albedo,
+                             std::vector<float>& normal) {
+  if (!m_denoise)
+    throw std::runtime_error("ERRO INTERNO: os buffers do denoiser não existem!");
+  moments.resize(3 * m_width * m_height);
+  albedo.resize(4 * m_width * m_height);
+  normal.resize(4 * m_width * m_height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo[m_current]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadBuffer(GL_COLOR_ATTACHMENT1);
+  glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_FLOAT, &moments[0]);
+  glReadBuffer(GL_COLOR_ATTACHMENT2);
+  glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_FLOAT, &albedo[0]);
+  glReadBuffer(GL_COLOR_ATTACHMENT3);
+  glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_FLOAT, &normal[0]);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
 void Renderer::terminate() {
+  finishStats();
   glUseProgram(0);
   glDeleteProgram(m_mainProgram);
   glDeleteProgram(m_blitProgram);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &m_vbo); 
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  collectSnapshots(true);
+  m_readback.destroy();
+  m_writer.finish();
+  glDeleteFramebuffers(2, m_fbo);
+  glDeleteTextures(2, m_accum);
+  glDeleteTextures(2, m_moments);
+  glDeleteRenderbuffers(1, &m_stencil);
+  glDeleteProgram(m_convergeProgram);
+  glDeleteProgram(m_denoiseProgram);
+  if (m_denoise) {
+    glDeleteFramebuffers(2, m_filterFBO);
+    glDeleteTextures(2, m_filter);
+    glDeleteTextures(2, m_aux);
+  }
+  for (size_t i = 0; i < m_convergeQueries.size(); ++i)
+    glDeleteQueries(1, &m_convergeQueries[i]);
+  glDeleteBuffers(1, &m_sceneUBO);
+  if (m_meshBuffers[0]) {
+    glDeleteTextures(2, m_meshTextures);
+    glDeleteBuffers(2, m_meshBuffers);
+  }
+  if (m_fieldTextures[0])
+    glDeleteTextures(3, m_fieldTextures);
+  m_timer.destroy();
+  m_stageTimer.destroy();
+#ifdef HAVE_EGL
+  if (m_headless) {
+    if (m_display != EGL_NO_DISPLAY) {
+      eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      if (m_context != EGL_NO_CONTEXT)
+        eglDestroyContext(m_display, m_context);
+      eglTerminate(m_display);
+    }
+    return;
+  }
+#endif
   glfwTerminate();
 }
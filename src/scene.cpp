@@ -0,0 +1,55 @@
+#include "scene.hpp"
+
+#include <cmath>
+
+#define PI 3.14159265359f
+
+std::vector<float> lightDistribution(const std::vector<SceneLight>& lights) {
+  std::vector<float> pdf(lights.size());
+  float sum = 0;
+  for (size_t i = 0; i < lights.size(); ++i) {
+    float emit = maxComponent(lights[i].color);
+    if (lights[i].type == 0) // luz pontual
+      pdf[i] = 4.0f * PI * emit;
+    else                     // luz esférica
+      pdf[i] = PI * emit * 4 * PI * std::pow(lights[i].radius, 2.0f);
+    sum += pdf[i];
+  }
+
+  for (size_t i = 0; i < lights.size(); ++i)
+    pdf[i] /= sum;
+  return pdf;
+}
+
+std::vector<LightAlias> lightAliasTable(const std::vector<float>& pdf) {
+  int n = pdf.size();
+  std::vector<LightAlias> table(n);
+  std::vector<double> scaled(n);
+  std::vector<int> small, large;
+  for (int i = 0; i < n; ++i) {
+    scaled[i] = double(pdf[i]) * n;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+
+  // Cada coluna pequena é completada por uma grande, que perde o excesso
+  // e volta para a lista certa.
+  while (!small.empty() && !large.empty()) {
+    int s = small.back(), l = large.back();
+    small.pop_back();
+    table[s].probability = scaled[s];
+    table[s].alias = l;
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // O que sobra só difere de 1 por arredondamento.
+  large.insert(large.end(), small.begin(), small.end());
+  for (size_t i = 0; i < large.size(); ++i) {
+    table[large[i]].probability = 1.0f;
+    table[large[i]].alias = large[i];
+  }
+  return table;
+}
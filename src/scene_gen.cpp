@@ -0,0 +1,168 @@
+#include "scene_gen.hpp"
+
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <iomanip>
+#include <stdexcept>
+
+#define GRID_SPACING 2.0f // distância entre os centros das células
+#define LIGHT_HEIGHT 4.0f // altura das esferas emissivas
+#define LIGHT_RADIUS 0.4f
+#define LIGHT_EMISSION 50.0f
+
+// Paleta dos materiais sólidos; o material 0 é o xadrez do chão.
+static const float PALETTE[][3] = {
+  {0.80f, 0.20f, 0.20f}, {0.20f, 0.60f, 0.25f}, {0.20f, 0.35f, 0.80f}, {0.90f, 0.75f, 0.20f},
+  {0.60f, 0.25f, 0.65f}, {0.20f, 0.70f, 0.75f}, {0.90f, 0.90f, 0.90f}, {0.90f, 0.45f, 0.15f}
+};
+static const int PALETTE_SIZE = sizeof(PALETTE) / sizeof(PALETTE[0]);
+
+// Propriedades, na ordem de GenFinish, seguidas da emissiva.
+static const char *PROPERTIES[] = {
+  "0 0 0 0 0 0 0",
+  "0 0 0 95 0 0 0",
+  "0 0 0 0 1 0 0",
+  "0 0 0 0 0 1 1.5",
+};
+
+SceneGenOptions::SceneGenOptions() : objects(100), emissive(4), seed(1) {
+  shapes[GEN_SPHERE] = 4.0f;
+  shapes[GEN_BOX] = 3.0f;
+  shapes[GEN_TORUS] = 2.0f;
+  shapes[GEN_POLYHEDRON] = 0.0f;
+  finishes[GEN_DIFFUSE] = 6.0f;
+  finishes[GEN_GLOSSY] = 2.0f;
+  finishes[GEN_MIRROR] = 1.0f;
+  finishes[GEN_GLASS] = 1.0f;
+}
+
+namespace {
+
+// O std::mt19937 produz a mesma sequência em qualquer biblioteca padrão,
+// ao contrário das distribuições; a conversão para float é feita aqui.
+class Random {
+ public:
+  Random(unsigned int seed) : m_engine(seed) {}
+  float uniform(float lo, float hi) {return lo + (hi - lo) * float(m_engine() / 4294967296.0);}
+
+  // Índice sorteado com probabilidade proporcional ao peso.
+  int pick(const float *weights, int count) {
+    float total = 0.0f;
+    for (int i = 0; i < count; ++i)
+      total += weights[i];
+    float u = uniform(0.0f, total);
+    for (int i = 0; i < count; ++i) {
+      if (u < weights[i])
+        return i;
+      u -= weights[i];
+    }
+    for (int i = count - 1; i > 0; --i)
+      if (weights[i] > 0.0f)
+        return i;
+    return 0;
+  }
+
+ private:
+  std::mt19937 m_engine;
+};
+
+}
+
+static void checkWeights(const float *weights, int count, const char *what) {
+  float total = 0.0f;
+  for (int i = 0; i < count; ++i) {
+    if (weights[i] < 0.0f || !std::isfinite(weights[i]))
+      throw std::runtime_error(std::string("Peso inválido em ") + what + "!");
+    total += weights[i];
+  }
+  if (total <= 0.0f)
+    throw std::runtime_error(std::string("Todos os pesos de ") + what + " são nulos!");
+}
+
+void generateScene(const SceneGenOptions& options, std::ostream& out) {
+  if (options.objects < 1)
+    throw std::runtime_error("A cena precisa de pelo menos um objeto!");
+  if (options.emissive < 0)
+    throw std::runtime_error("Número de esferas emissivas inválido!");
+  checkWeights(options.shapes, GEN_SHAPES, "formas");
+  checkWeights(options.finishes, GEN_FINISHES, "acabamentos");
+
+  Random random(options.seed);
+  int cells = int(std::ceil(std::sqrt(float(options.objects))));
+  float side = cells * GRID_SPACING;
+  float first = -0.5f * side + 0.5f * GRID_SPACING;
+
+  // A câmera fica do lado +z, acima da grade; as paredes ficam além dela.
+  float distance = 0.9f * side + 4.0f, height = 0.6f * side + 3.0f;
+  float wallRadius = distance + side;
+
+  std::stringstream objects;
+  objects << std::fixed << std::setprecision(3);
+  int count = 0, walls = 0;
+  for (int i = 0; i < options.objects; ++i) {
+    int shape = random.pick(options.shapes, GEN_SHAPES);
+    if (shape == GEN_POLYHEDRON) {
+      walls++;
+      continue;
+    }
+    float x = first + (i % cells) * GRID_SPACING + random.uniform(-0.3f, 0.3f);
+    float z = first + (i / cells) * GRID_SPACING + random.uniform(-0.3f, 0.3f);
+    int material = 1 + int(random.uniform(0.0f, float(PALETTE_SIZE))) % PALETTE_SIZE;
+    int property = random.pick(options.finishes, GEN_FINISHES);
+    objects << material << " " << property << " ";
+    if (shape == GEN_SPHERE) {
+      float r = random.uniform(0.3f, 0.8f);
+      objects << "sphere " << x << " " << r << " " << z << " " << r;
+    } else if (shape == GEN_BOX) {
+      float sx = random.uniform(0.3f, 0.7f), sy = random.uniform(0.3f, 0.7f);
+      float sz = random.uniform(0.3f, 0.7f);
+      objects << "box " << x << " " << sy << " " << z << " " << sx << " " << sy << " " << sz;
+    } else {
+      float r1 = random.uniform(0.4f, 0.7f), r2 = random.uniform(0.1f, 0.25f);
+      objects << "torus " << x << " " << r2 << " " << z << " " << r1 << " " << r2;
+    }
+    objects << std::endl;
+    count++;
+  }
+
+  // Paredes: uma face cada, tangentes a um círculo ao redor da grade e da
+  // câmera, a primeira atrás da grade.
+  for (int i = 0; i < walls; ++i) {
+    float angle = float(M_PI) + 2.0f * float(M_PI) * i / walls;
+    objects << "0 0 polyhedron 1" << std::endl
+            << "  " << -std::sin(angle) << " 0 " << -std::cos(angle) << " " << wallRadius << std::endl;
+  }
+
+  out << std::fixed << std::setprecision(3);
+  out << "0 " << height << " " << distance << std::endl
+      << "0 0 0" << std::endl << "0 1 0" << std::endl << "50" << std::endl;
+
+  // Sem esferas emissivas, uma luz pontual acima do centro da grade.
+  if (options.emissive == 0) {
+    float h = 0.5f * side + 6.0f;
+    out << "1" << std::endl << "0 " << h << " 0 " << 6.0f*h*h << " " << 6.0f*h*h << " " << 6.0f*h*h << std::endl;
+  } else {
+    out << "0" << std::endl;
+  }
+
+  out << PALETTE_SIZE + 1 << std::endl << "checker 0.8 0.8 0.8 0.3 0.3 0.3 1" << std::endl;
+  for (int i = 0; i < PALETTE_SIZE; ++i)
+    out << "solid " << PALETTE[i][0] << " " << PALETTE[i][1] << " " << PALETTE[i][2] << std::endl;
+
+  out << GEN_FINISHES + 1 << std::endl;
+  for (int i = 0; i < GEN_FINISHES; ++i)
+    out << PROPERTIES[i] << std::endl;
+  out << LIGHT_EMISSION << " " << LIGHT_EMISSION << " " << LIGHT_EMISSION << " 0 0 0 0" << std::endl;
+
+  // Chão, objetos, paredes e esferas emissivas sobre a grade.
+  out << count + walls + options.emissive + 1 << std::endl
+      << "0 0 polyhedron 1" << std::endl << "  0 1 0 0" << std::endl
+      << objects.str();
+  for (int i = 0; i < options.emissive; ++i) {
+    float x = random.uniform(-0.5f, 0.5f) * side, z = random.uniform(-0.5f, 0.5f) * side;
+    out << "7 " << GEN_FINISHES << " sphere " << x << " " << LIGHT_HEIGHT << " " << z << " "
+        << LIGHT_RADIUS << std::endl;
+  }
+}
@@ -0,0 +1,232 @@
+#include "shader_generator.hpp"
+#include "parser.hpp"
+
+#include <set>
+#include <stdexcept>
+#include <iomanip>
+#include <limits>
+
+// Escreve um float como literal GLSL sem perder precisão.
+static std::string literal(float x) {
+  std::stringstream ss;
+  ss << std::setprecision(std::numeric_limits<float>::max_digits10) << x;
+  std::string s = ss.str();
+  if (s.find_first_of(".einf") == std::string::npos)
+    s += ".0";
+  return s;
+}
+
+static std::string vec(const std::vector<float>& v, size_t first, size_t count) {
+  std::stringstream ss;
+  ss << "vec" << count << "(";
+  for (size_t i = 0; i < count; ++i)
+    ss << (i ? "," : "") << literal(v[first + i]);
+  ss << ")";
+  return ss.str();
+}
+
+static std::string vec(const vec3& v) {
+  return "vec3(" + literal(v.x) + "," + literal(v.y) + "," + literal(v.z) + ")";
+}
+
+std::string ShaderGenerator::generate() const {
+  return camera() + externalObjects() + map() + mapMat() + normals() + meshes() + field();
+}
+
+std::string ShaderGenerator::camera() const {
+  const SceneCamera& cam = m_scene.camera;
+  std::stringstream camera;
+
+  camera << "void buildCamera(out vec3 ro, out vec3 rd) {" << std::endl
+         << "ro = " << vec(cam.position) << ";" << std::endl
+         << "vec3 t = " << vec(cam.target) << ", n = " << vec(cam.up) << ";" << std::endl
+         << "vec3 f = normalize(ro - t);" << std::endl
+         << "vec3 r = normalize(cross(normalize(n), f));" << std::endl
+         << "vec3 u = normalize(cross(f, r));" << std::endl
+         << "vec2 uv = (-iResolution.xy+2.0*gl_FragCoord.xy)/iResolution.y;" << std::endl
+         << "uv += 0.0055*(2.0*rand2() - 1.0);" << std::endl
+         << "uv *= tan(0.5*" << literal(cam.fov) << "*3.141592/180);" << std::endl
+         << "rd = normalize(mat3(r,u,f)*vec3(uv, -1.0));" << std::endl
+         << "}" << std::endl;
+  return camera.str();
+}
+
+// Inclui uma única vez o shader de cada tipo de objeto externo.
+std::string ShaderGenerator::externalObjects() const {
+  std::set<std::string> included;
+  std::string code;
+  for (auto it = m_scene.objects.begin(); it != m_scene.objects.end(); ++it) {
+    if (it->type != PRIMITIVE_CUSTOM || !included.insert(it->name).second)
+      continue;
+    ShaderReader reader("shaders/" + it->name + ".glsl");
+    code += reader.read();
+  }
+  return code;
+}
+
+// Interseção com as malhas: o mesh.glsl e a tabela de materiais de cada
+// objeto. Sem malhas, funções que nunca acertam, eliminadas pelo
+// compilador.
+std::string ShaderGenerator::meshes() const {
+  std::stringstream ss;
+  if (m_scene.meshes.empty()) {
+    ss << "float traceMesh(vec3 ro, vec3 rd, float tmax, out ivec4 mat, out vec3 n) {" << std::endl
+       << "mat = ivec4(0); n = vec3(0.0); return -1.0;" << std::endl << "}" << std::endl
+       << "bool occludedMesh(vec3 ro, vec3 rd, float tmax) {return false;}" << std::endl;
+    return ss.str();
+  }
+
+  ss << ShaderReader("shaders/mesh.glsl").read()
+     << "ivec4 meshMaterial(int object) {" << std::endl << "switch (object) {" << std::endl;
+  for (auto it = m_scene.meshes.begin(); it != m_scene.meshes.end(); ++it) {
+    const ScenePrimitive& object = m_scene.objects[it->object];
+    const SceneMaterial& material = m_scene.materials[object.material];
+    ss << "case " << it->object << ": return ivec4(" << material.type << "," << material.index
+       << "," << object.property << "," << it->object << ");" << std::endl;
+  }
+  ss << "}" << std::endl << "return ivec4(0);" << std::endl << "}" << std::endl;
+  return ss.str();
+}
+
+// Passos da marcha: o field.glsl, cujas texturas são enviadas por
+// Renderer::bakeField, ou o próprio map().
+std::string ShaderGenerator::field() const {
+  if (m_field)
+    return ShaderReader("shaders/field.glsl").read();
+  return "float fieldMap(vec3 p, float s, float near) {return s*map(p);}\n";
+}
+
+// Expressão GLSL da distância até um objeto.
+std::string ShaderGenerator::distance(const ScenePrimitive& object) const {
+  const std::vector<float>& p = object.params;
+  switch (object.type) {
+    case PRIMITIVE_SPHERE:
+      return "sphere(p," + vec(p, 0, 4) + ")";
+    case PRIMITIVE_POLYHEDRON: {
+      // Interseção dos semiespaços: min(plane(...), min(plane(...), ...))
+      size_t faces = p.size() / 4;
+      std::string expr;
+      for (size_t j = 0; j+1 < faces; ++j)
+        expr += "min(plane(p," + vec(p, 4*j, 4) + "),";
+      expr += "plane(p," + vec(p, 4*(faces-1), 4) + ")";
+      expr += std::string(faces - 1, ')');
+      return expr;
+    }
+    case PRIMITIVE_BOX:
+      return "box(p," + vec(p, 0, 3) + "," + vec(p, 3, 3) + ")";
+    case PRIMITIVE_TORUS:
+      return "torus(p," + vec(p, 0, 3) + "," + vec(p, 3, 2) + ")";
+    case PRIMITIVE_CONE:
+      return "cone(p," + vec(p, 0, 3) + "," + vec(p, 3, 2) + ")";
+    case PRIMITIVE_CYLINDER:
+      return "cylinder(p," + vec(p, 0, 3) + "," + vec(p, 3, 2) + ")";
+    case PRIMITIVE_DISK:
+      return "disk(p," + vec(p, 0, 3) + "," + vec(p, 3, 3) + "," + literal(p[6]) + ")";
+    case PRIMITIVE_CUSTOM:
+      return object.name + "(p," + vec(p, 0, 3) + ")";
+    case PRIMITIVE_MESH:
+      break;
+  }
+  throw std::runtime_error("ERRO INTERNO: tipo de objeto desconhecido!");
+}
+
+void ShaderGenerator::writeObject(std::stringstream& ss, int id, bool select) const {
+  const ScenePrimitive& object = m_scene.objects[id];
+  if (!select) {
+    ss << "d = min(d, " << distance(object) << ");" << std::endl;
+    return;
+  }
+  const SceneMaterial& material = m_scene.materials[object.material];
+  ss << "aux = " << distance(object) << ";" << std::endl
+     << "if (aux < d) {d = aux; mat = ivec4(" << material.type << ","
+     << material.index << "," << object.property << "," << id << ");}" << std::endl;
+}
+
+// Uma subárvore só é avaliada se a sua caixa estiver a no máximo max(d, 0).
+// A distância até a caixa não excede a distância até os objetos, e dentro
+// dela é zero: com d negativo (p dentro de um objeto já avaliado), só as
+// caixas que contêm p podem ter objetos com distância ainda menor.
+void ShaderGenerator::writeNode(std::stringstream& ss, int node, bool select) const {
+  const BVHNode& n = m_bvh.nodes()[node];
+  ss << "if (bound(p," << vec(n.box.lo) << "," << vec(n.box.hi) << ") <= max(d, 0.0)) {" << std::endl;
+  if (n.left < 0) {
+    for (int i = n.first; i < n.first + n.count; ++i)
+      writeObject(ss, m_bvh.primitives()[i], select);
+  } else {
+    writeNode(ss, n.left, select);
+    writeNode(ss, n.right, select);
+  }
+  ss << "}" << std::endl;
+}
+
+std::string ShaderGenerator::map() const {
+  std::stringstream map;
+  map << "float map(vec3 p) {" << std::endl
+      << "float d = FAR;" << std::endl;
+  for (auto it = m_bvh.unbounded().begin(); it != m_bvh.unbounded().end(); ++it)
+    writeObject(map, *it, false);
+  if (!m_bvh.nodes().empty())
+    writeNode(map, 0, false);
+  map << "return d;" << std::endl << "}" << std::endl;
+  return map.str();
+}
+
+// Mesma função do map(), mas também guarda o material do objeto mais
+// próximo; usada pelo raycast para dispensar uma segunda avaliação.
+std::string ShaderGenerator::mapMat() const {
+  std::stringstream select;
+  select << "float mapMat(vec3 p, out ivec4 mat) {" << std::endl
+         << "float d = FAR, aux; mat = ivec4(0);" << std::endl;
+  for (auto it = m_bvh.unbounded().begin(); it != m_bvh.unbounded().end(); ++it)
+    writeObject(select, *it, true);
+  if (!m_bvh.nodes().empty())
+    writeNode(select, 0, true);
+  select << "return d;" << std::endl << "}" << std::endl;
+  return select.str();
+}
+
+// Normal analítica de um objeto, ou vazio se ele não tiver uma (nesse caso
+// vale o gradiente numérico do calcNormal(p)).
+std::string ShaderGenerator::normal(const ScenePrimitive& object) const {
+  const std::vector<float>& p = object.params;
+  std::string side = "side(" + distance(object) + ")*";
+  switch (object.type) {
+    case PRIMITIVE_SPHERE:
+      return "return " + side + "sphereNormal(p," + vec(p, 0, 4) + ");";
+    case PRIMITIVE_BOX:
+      return "return " + side + "boxNormal(p," + vec(p, 0, 3) + "," + vec(p, 3, 3) + ");";
+    case PRIMITIVE_TORUS:
+      return "return " + side + "torusNormal(p," + vec(p, 0, 3) + "," + vec(p, 3, 2) + ");";
+    case PRIMITIVE_CYLINDER:
+      return "return " + side + "cylinderNormal(p," + vec(p, 0, 3) + "," + vec(p, 3, 2) + ");";
+    case PRIMITIVE_POLYHEDRON: {
+      // O poliedro é o mínimo dos planos: a normal é a do plano mais próximo.
+      std::stringstream ss;
+      ss << "vec4 pl = " << vec(p, 0, 4) << "; float dm = plane(p, pl), di;";
+      for (size_t j = 4; j < p.size(); j += 4)
+        ss << std::endl << "di = plane(p," << vec(p, j, 4) << "); if (di < dm) {dm = di; pl = "
+           << vec(p, j, 4) << ";}";
+      ss << std::endl << "return side(dm)*normalize(pl.xyz);";
+      return ss.str();
+    }
+    default:
+      return "";
+  }
+}
+
+std::string ShaderGenerator::normals() const {
+  std::stringstream cases, normals;
+  for (size_t i = 0; i < m_scene.objects.size(); ++i) {
+    if (m_scene.objects[i].type == PRIMITIVE_MESH) // normal do triângulo (traceMesh)
+      continue;
+    std::string n = normal(m_scene.objects[i]);
+    if (!n.empty())
+      cases << "case " << i << ": {" << std::endl << n << std::endl << "}" << std::endl;
+  }
+
+  normals << "vec3 calcNormal(vec3 p, int id) {" << std::endl;
+  if (!cases.str().empty())
+    normals << "switch (id) {" << std::endl << cases.str() << "}" << std::endl;
+  normals << "return calcNormal(p);" << std::endl << "}" << std::endl;
+  return normals.str();
+}
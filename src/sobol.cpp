@@ -0,0 +1,39 @@
+#include "sobol.hpp"
+
+#include <stdexcept>
+
+// Polinômio primitivo (grau s, coeficientes a) e números de direção
+// iniciais m das dimensões 1, 2, 3 (new-joe-kuo-6.21201).
+struct SobolParams {
+  unsigned int s, a, m[3];
+};
+
+static const SobolParams PARAMS[] = {
+  {1, 0, {1, 0, 0}},
+  {2, 1, {1, 3, 0}},
+  {3, 1, {1, 3, 1}},
+};
+
+std::vector<uint32_t> sobolMatrices(int dimensions) {
+  if (dimensions < 1 || dimensions > 1 + int(sizeof(PARAMS) / sizeof(PARAMS[0])))
+    throw std::runtime_error("Número de dimensões de Sobol não suportado!");
+
+  std::vector<uint32_t> matrices(32 * dimensions);
+  for (int i = 0; i < 32; ++i)
+    matrices[i] = 1u << (31 - i);
+
+  for (int d = 1; d < dimensions; ++d) {
+    const SobolParams& p = PARAMS[d - 1];
+    uint32_t *v = &matrices[32 * d];
+    for (unsigned int i = 0; i < 32; ++i) {
+      if (i < p.s) {
+        v[i] = p.m[i] << (31 - i);
+      } else {
+        v[i] = v[i - p.s] ^ (v[i - p.s] >> p.s);
+        for (unsigned int k = 1; k < p.s; ++k)
+          v[i] ^= ((p.a >> (p.s - 1 - k)) & 1u) * v[i - k];
+      }
+    }
+  }
+  return matrices;
+}
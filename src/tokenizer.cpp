@@ -0,0 +1,193 @@
+#include "tokenizer.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Potências de 10 exatas em double.
+static const double POW10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool isDigit(char c) {return c >= '0' && c <= '9';}
+
+// Converte [begin, end) inteiro em um número, no formato
+// [+-]dígitos[.dígitos][(e|E)[+-]dígitos]. Os primeiros 19 dígitos
+// significativos formam a mantissa; até 2^53, e com expoente de até 22, o
+// resultado em double é exato antes da conversão para float.
+static bool parseNumber(const char *p, const char *end, double& value) {
+  bool negative = false;
+  if (p != end && (*p == '+' || *p == '-'))
+    negative = (*p++ == '-');
+
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for (; p != end && isDigit(*p); ++p, any = true) {
+    if (digits < 19) {
+      mantissa = 10 * mantissa + (*p - '0');
+      digits += mantissa > 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (p != end && *p == '.') {
+    for (++p; p != end && isDigit(*p); ++p, any = true) {
+      if (digits < 19) {
+        mantissa = 10 * mantissa + (*p - '0');
+        digits += mantissa > 0;
+        exponent--;
+      }
+    }
+  }
+  if (!any)
+    return false;
+
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negativeExp = false;
+    if (p != end && (*p == '+' || *p == '-'))
+      negativeExp = (*p++ == '-');
+    if (p == end || !isDigit(*p))
+      return false;
+    int e = 0;
+    for (; p != end && isDigit(*p); ++p)
+      e = e < 10000 ? 10 * e + (*p - '0') : e;
+    exponent += negativeExp ? -e : e;
+  }
+  if (p != end)
+    return false;
+
+  value = double(mantissa);
+  if (mantissa != 0) {
+    if (exponent >= 0 && exponent <= 22)
+      value *= POW10[exponent];
+    else if (exponent < 0 && exponent >= -22)
+      value /= POW10[-exponent];
+    else
+      value *= std::pow(10.0, exponent);
+  }
+  if (negative)
+    value = -value;
+  return true;
+}
+
+Tokenizer::Tokenizer(const std::string& file)
+  : m_file(file), m_data(NULL), m_size(0), m_line(1) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Arquivo não encontrado: " + file);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Erro durante a leitura do arquivo " + file);
+  }
+  // mmap não aceita tamanho zero; um arquivo vazio fica sem mapeamento.
+  if (st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Erro durante a leitura do arquivo " + file);
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(data);
+    m_size = st.st_size;
+  }
+  close(fd);
+
+  m_pos = m_lineStart = m_data;
+  m_end = m_data + m_size;
+}
+
+Tokenizer::~Tokenizer() {
+  if (m_size > 0)
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+void Tokenizer::skipSpaces() {
+  for (; m_pos != m_end && isSpace(*m_pos); ++m_pos) {
+    if (*m_pos == '\n') {
+      m_line++;
+      m_lineStart = m_pos + 1;
+    }
+  }
+}
+
+bool Tokenizer::atEnd() {
+  skipSpaces();
+  return m_pos == m_end;
+}
+
+bool Tokenizer::atLineEnd() {
+  while (m_pos != m_end && *m_pos != '\n' && isSpace(*m_pos))
+    ++m_pos;
+  return m_pos == m_end || *m_pos == '\n';
+}
+
+void Tokenizer::skipLine() {
+  while (m_pos != m_end && *m_pos != '\n')
+    ++m_pos;
+}
+
+Token Tokenizer::word() {
+  skipSpaces();
+  Token token;
+  token.begin = m_pos;
+  token.line = m_line;
+  token.column = int(m_pos - m_lineStart) + 1;
+  while (m_pos != m_end && !isSpace(*m_pos))
+    ++m_pos;
+  token.size = m_pos - token.begin;
+  if (token.size == 0)
+    error(token, "fim inesperado do arquivo");
+  return token;
+}
+
+float Tokenizer::number() {
+  Token token = word();
+  double value;
+  if (!parseNumber(token.begin, token.begin + token.size, value))
+    error(token, "número esperado, encontrado '" + token.str() + "'");
+  return float(value);
+}
+
+int Tokenizer::integer(Token *where) {
+  Token token = word();
+  if (where)
+    *where = token;
+  const char *p = token.begin, *end = token.begin + token.size;
+  bool negative = false;
+  if (p != end && (*p == '+' || *p == '-'))
+    negative = (*p++ == '-');
+  // Acumula antes de comparar: o valor parcial nunca passa de INT_MAX + 1,
+  // e dez vezes isso ainda cabe em long long.
+  long long value = 0, limit = negative ? -(long long)INT_MIN : INT_MAX;
+  if (p == end)
+    error(token, "inteiro esperado, encontrado '" + token.str() + "'");
+  for (; p != end; ++p) {
+    if (!isDigit(*p))
+      error(token, "inteiro esperado, encontrado '" + token.str() + "'");
+    value = 10 * value + (*p - '0');
+    if (value > limit)
+      error(token, "inteiro fora do intervalo: '" + token.str() + "'");
+  }
+  return int(negative ? -value : value);
+}
+
+void Tokenizer::error(const Token& token, const std::string& message) const {
+  std::stringstream ss;
+  ss << m_file << ":" << token.line << ":" << token.column << ": " << message;
+  throw std::runtime_error(ss.str());
+}
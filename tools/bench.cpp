@@ -0,0 +1,355 @@
+#include "renderer.hpp"
+#include "parser.hpp"
+#include "shader_generator.hpp"
+#include "image_writer.hpp"
+#include "scene_gen.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// pathtracer-bench: renderiza cada cena de um diretório sem janela, com um
+// número fixo de amostras e em resoluções fixas, e grava em JSON os tempos
+// de compilação, até a primeira amostra, a vazão e o RMSE contra imagens de
+// referência. Cada resultado ocupa uma linha, para que os arquivos de dois
+// commits possam ser comparados com diff. Com --scaling, cenas geradas
+// com números crescentes de primitivas dão as curvas de compilação e vazão
+// em função do tamanho da cena.
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchOptions {
+  std::string scenes, references, out, generated;
+  std::vector<std::pair<int, int> > resolutions;
+  std::vector<int> scaling; // primitivas de cada cena gerada
+  int spp, sppPass, referenceSpp;
+  bool updateReferences;
+};
+
+struct BenchResult {
+  std::string scene;
+  int width, height;
+  size_t objects;
+  unsigned int samples;
+  double contextMs, parseMs, compileMs, firstSampleMs, samplesPerSecond;
+  double rmse;       // negativo sem imagem de referência
+  std::string error;
+};
+
+static double milliseconds(Clock::time_point a, Clock::time_point b) {
+  return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// Arquivos .in do diretório, em ordem alfabética.
+static std::vector<std::string> listScenes(const std::string& dir) {
+  DIR *d = opendir(dir.c_str());
+  if (!d)
+    throw std::runtime_error("Não foi possível abrir o diretório " + dir);
+  std::vector<std::string> scenes;
+  while (struct dirent *entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".in") == 0)
+      scenes.push_back(name.substr(0, name.size() - 3));
+  }
+  closedir(d);
+  std::sort(scenes.begin(), scenes.end());
+  return scenes;
+}
+
+// Lê um PFM RGB gravado pelo ImageWriter (little endian, de baixo para cima).
+static bool readPFM(const std::string& path, int& width, int& height, std::vector<float>& rgb) {
+  std::ifstream input(path.c_str(), std::ios::binary);
+  std::string magic;
+  float scale;
+  if (!(input >> magic >> width >> height >> scale) || magic != "PF" || scale >= 0)
+    return false;
+  input.get();
+  rgb.resize(3 * size_t(width) * height);
+  input.read(reinterpret_cast<char*>(&rgb[0]), rgb.size() * sizeof(float));
+  return bool(input);
+}
+
+// Erro quadrático médio da radiância, ignorando pixels inválidos (NaN).
+static double rmse(const std::vector<float>& a, const std::vector<float>& b) {
+  double sum = 0.0;
+  size_t count = 0;
+  for (size_t i = 0; i < a.size(); ++i)
+    if (std::isfinite(a[i]) && std::isfinite(b[i])) {
+      sum += (double(a[i]) - b[i]) * (double(a[i]) - b[i]);
+      count++;
+    }
+  return count ? std::sqrt(sum / count) : 0.0;
+}
+
+static std::string referencePath(const BenchOptions& options, const std::string& scene,
+                                 int width, int height) {
+  std::stringstream ss;
+  ss << options.references << "/" << scene << "_" << width << "x" << height << ".pfm";
+  return ss.str();
+}
+
+// Renderiza uma cena do início ao fim em um contexto próprio, como o
+// pathtracer --headless faria, sem o cache de programas.
+static BenchResult runScene(const BenchOptions& options, const std::string& scene,
+                            const std::string& file, int width, int height, int spp,
+                            std::string& rendererName) {
+  BenchResult result;
+  result.scene = scene;
+  result.width = width;
+  result.height = height;
+  result.objects = 0;
+  result.samples = 0;
+  result.contextMs = result.parseMs = result.compileMs = result.firstSampleMs = result.samplesPerSecond = 0.0;
+  result.rmse = -1.0;
+
+  // A criação do contexto (EGL, GLEW) varia muito entre drivers e fica de
+  // fora dos demais tempos.
+  Clock::time_point context = Clock::now();
+  Renderer renderer(0.0f);
+  renderer.setSamplesPerPass(options.sppPass);
+  renderer.setProgramCache(false);
+  renderer.setupHeadless(width, height);
+  renderer.setSamples(spp);
+  Clock::time_point start = Clock::now();
+  result.contextMs = milliseconds(context, start);
+  if (rendererName.empty())
+    rendererName = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+  try {
+    Parser parser(file);
+    parser.read();
+    result.objects = parser.getScene().objects.size();
+    ShaderGenerator generator(parser.getScene());
+    std::string fragment = ShaderReader("shaders/template.glsl").read() + generator.generate();
+    Clock::time_point parsed = Clock::now();
+    result.parseMs = milliseconds(start, parsed);
+
+    renderer.setupProgram(ShaderReader("shaders/vertex.glsl").read(), fragment,
+                          ShaderReader("shaders/blit.glsl").read(),
+                          ShaderReader("shaders/converge.glsl").read(),
+                          ShaderReader("shaders/denoise.glsl").read());
+    glFinish();
+    result.compileMs = milliseconds(parsed, Clock::now());
+    renderer.uploadScene(parser.getScene());
+    TextureLoader texLoader;
+    texLoader.load(parser.getTextures());
+    if (glGetError() != GL_NO_ERROR)
+      throw std::runtime_error("Erro no OpenGL!");
+
+    renderer.render();
+    result.samples = renderer.getRenderedSamples();
+    result.firstSampleMs = milliseconds(start, renderer.getFirstSampleTime());
+    result.samplesPerSecond = result.samples / renderer.getRenderTime();
+
+    std::vector<float> image = renderer.readImage();
+    std::string path = referencePath(options, scene, width, height);
+    if (options.updateReferences) {
+      ImageWriter(path).write(image, width, height);
+    } else {
+      int w, h;
+      std::vector<float> reference;
+      if (readPFM(path, w, h, reference) && w == width && h == height)
+        result.rmse = rmse(image, reference);
+    }
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  renderer.terminate();
+  return result;
+}
+
+static std::string jsonString(const std::string& s) {
+  std::string out = "\"";
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\')
+      out += '\\';
+    out += (s[i] == '\n') ? ' ' : s[i];
+  }
+  return out + "\"";
+}
+
+static void writeResults(std::ostream& out, const BenchOptions& options, const std::string& renderer,
+                         const std::vector<BenchResult>& results) {
+  out << std::fixed << std::setprecision(3);
+  out << "{\n  \"renderer\": " << jsonString(renderer) << ",\n"
+      << "  \"spp\": " << options.spp << ",\n  \"spp_pass\": " << options.sppPass << ",\n"
+      << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    out << "    {\"scene\": " << jsonString(r.scene) << ", \"width\": " << r.width
+        << ", \"height\": " << r.height << ", \"objects\": " << r.objects
+        << ", \"samples\": " << r.samples
+        << ", \"context_ms\": " << r.contextMs << ", \"parse_ms\": " << r.parseMs << ", \"compile_ms\": " << r.compileMs
+        << ", \"first_sample_ms\": " << r.firstSampleMs
+        << ", \"samples_per_s\": " << r.samplesPerSecond << ", \"rmse\": ";
+    if (r.rmse >= 0.0)
+      out << std::setprecision(6) << r.rmse << std::setprecision(3);
+    else
+      out << "null";
+    out << ", \"error\": " << (r.error.empty() ? "null" : jsonString(r.error))
+        << ((i + 1 < results.size()) ? "},\n" : "}\n");
+  }
+  out << "  ]\n}\n";
+}
+
+static void usage(const char *name) {
+  std::cout << name << " [opções]" << std::endl
+            << "Renderiza sem janela todas as cenas de um diretório e grava os resultados em JSON." << std::endl << std::endl
+            << "Opções:" << std::endl
+            << "  --scenes DIR      diretório das cenas .in (padrão: scenes)" << std::endl
+            << "  --res LxA         resolução; pode ser repetida (padrão: 160x120 e 320x240)" << std::endl
+            << "  --spp N           amostras por pixel (padrão: 16)" << std::endl
+            << "  --spp-pass N      amostras por passo (padrão: 4)" << std::endl
+            << "  --references DIR  imagens de referência, cena_LxA.pfm (padrão: references)" << std::endl
+            << "  --update-references  renderiza as referências com --reference-spp amostras" << std::endl
+            << "  --reference-spp N amostras das referências (padrão: 1024)" << std::endl
+            << "  --scaling N,N,... também roda cenas geradas com N primitivas cada" << std::endl
+            << "  --generated DIR   onde gravar as cenas geradas (padrão: generated)" << std::endl
+            << "  --out ARQUIVO     resultados em JSON (padrão: saída padrão)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions options;
+  options.scenes = "scenes";
+  options.references = "references";
+  options.generated = "generated";
+  options.spp = 16;
+  options.sppPass = 4;
+  options.referenceSpp = 1024;
+  options.updateReferences = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--scenes") && i+1 < argc) {
+      options.scenes = argv[++i];
+    } else if (!strcmp(argv[i], "--res") && i+1 < argc) {
+      int w = 0, h = 0;
+      if (sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+        std::cout << "Resolução inválida: " << argv[i] << std::endl;
+        return EXIT_FAILURE;
+      }
+      options.resolutions.push_back(std::make_pair(w, h));
+    } else if (!strcmp(argv[i], "--spp") && i+1 < argc) {
+      options.spp = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--spp-pass") && i+1 < argc) {
+      options.sppPass = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--references") && i+1 < argc) {
+      options.references = argv[++i];
+    } else if (!strcmp(argv[i], "--update-references")) {
+      options.updateReferences = true;
+    } else if (!strcmp(argv[i], "--reference-spp") && i+1 < argc) {
+      options.referenceSpp = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--scaling") && i+1 < argc) {
+      std::stringstream ss(argv[++i]);
+      std::string item;
+      while (std::getline(ss, item, ',')) {
+        int objects = atoi(item.c_str());
+        if (objects <= 0) {
+          std::cout << "Número de primitivas inválido: " << item << std::endl;
+          return EXIT_FAILURE;
+        }
+        options.scaling.push_back(objects);
+      }
+    } else if (!strcmp(argv[i], "--generated") && i+1 < argc) {
+      options.generated = argv[++i];
+    } else if (!strcmp(argv[i], "--out") && i+1 < argc) {
+      options.out = argv[++i];
+    } else {
+      usage(argv[0]);
+      return strcmp(argv[i], "--help") ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+  }
+  if (options.resolutions.empty()) {
+    options.resolutions.push_back(std::make_pair(160, 120));
+    options.resolutions.push_back(std::make_pair(320, 240));
+  }
+  if (options.spp <= 0 || options.sppPass <= 0 || options.referenceSpp <= 0) {
+    std::cout << "O número de amostras precisa ser positivo!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Os caches de shaders dos drivers (Mesa, NVIDIA) esconderiam o tempo de
+  // compilação; podem ser religados pelo ambiente.
+  setenv("MESA_SHADER_CACHE_DISABLE", "true", 0);
+  setenv("__GL_SHADER_DISK_CACHE", "0", 0);
+
+  // Sem --out, o JSON vai para o stdout original; o que o Renderer e o
+  // progresso escrevem no std::cout durante as cenas segue para o stderr.
+  int json = -1;
+  if (options.out.empty()) {
+    std::cout.flush();
+    json = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+  }
+
+  std::vector<BenchResult> results;
+  std::string rendererName;
+  try {
+    // Cenas do diretório e, depois, as geradas em ordem de tamanho, com a
+    // semente e as proporções padrão do pathtracer-scenegen.
+    std::vector<std::string> scenes = listScenes(options.scenes), files;
+    for (size_t i = 0; i < scenes.size(); ++i)
+      files.push_back(options.scenes + "/" + scenes[i] + ".in");
+    if (!options.scaling.empty())
+      mkdir(options.generated.c_str(), 0755);
+    for (size_t i = 0; i < options.scaling.size(); ++i) {
+      std::stringstream name;
+      name << "generated_" << options.scaling[i];
+      std::string file = options.generated + "/" + name.str() + ".in";
+      std::ofstream out(file.c_str());
+      if (!out.is_open())
+        throw std::runtime_error("Não foi possível criar o arquivo " + file);
+      SceneGenOptions generator;
+      generator.objects = options.scaling[i];
+      generateScene(generator, out);
+      scenes.push_back(name.str());
+      files.push_back(file);
+    }
+
+    if (options.updateReferences)
+      mkdir(options.references.c_str(), 0755);
+    int spp = options.updateReferences ? options.referenceSpp : options.spp;
+    for (size_t i = 0; i < scenes.size(); ++i)
+      for (size_t j = 0; j < options.resolutions.size(); ++j) {
+        int width = options.resolutions[j].first, height = options.resolutions[j].second;
+        std::cerr << "== " << scenes[i] << " " << width << "x" << height << std::endl;
+        results.push_back(runScene(options, scenes[i], files[i], width, height, spp, rendererName));
+        if (!results.back().error.empty())
+          std::cerr << results.back().error << std::endl;
+      }
+  } catch (const std::exception& e) {
+    // Sem contexto (ex.: compilado sem EGL) nenhuma cena pode rodar.
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (options.out.empty()) {
+    std::cout.flush();
+    dup2(json, STDOUT_FILENO);
+    close(json);
+    writeResults(std::cout, options, rendererName, results);
+  } else {
+    std::ofstream out(options.out.c_str());
+    if (!out.is_open()) {
+      std::cerr << "Não foi possível criar o arquivo " << options.out << std::endl;
+      return EXIT_FAILURE;
+    }
+    writeResults(out, options, rendererName, results);
+  }
+
+  for (size_t i = 0; i < results.size(); ++i)
+    if (!results[i].error.empty())
+      return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}